@@ -0,0 +1,383 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "game.cpp"
+#include "io.cpp"
+#include "search.cpp"
+#include "heuristic.cpp"
+#include "mincostheuristic.cpp"
+#include "cost.cpp"
+#include "level.cpp"
+#include "pushgame.cpp"
+#include "dispatch.cpp"
+#include "collection.cpp"
+#include "cache.cpp"
+#include "trace.cpp"
+
+#ifndef BATCH_H
+#define BATCH_H
+
+/** *************************************************************************
+ * Batch Mode
+ * ************************************************************************** */
+
+/**
+ * Settings shared by all levels of a batch.
+ */
+struct BatchOptions {
+	bool old_fmt;
+	bool simple_heuristic;
+	const char *cost;     // Cost model name, NULL for moves
+	bool macros;
+	bool corrals;
+	int jobs;             // Number of worker threads
+	double max_seconds;   // Per level, 0 for no limit
+	size_t max_memory;    // Per level, 0 for no limit
+	SolutionCache *cache; // NULL for none
+	bool stats;           // Report search statistics per level
+	bool partial;         // A* with partial expansion
+
+	BatchOptions() : old_fmt(false), simple_heuristic(false), cost(NULL),
+		macros(false), corrals(false), jobs(1), max_seconds(0), max_memory(0),
+		cache(NULL), stats(false), partial(false) {}
+};
+
+/**
+ * Outcome of solving one level.
+ */
+struct BatchResult {
+	const char *status; // solved, unsolvable, timeout, memout or error
+	unsigned long moves;
+	unsigned long pushes;
+	unsigned long expansions;
+	double seconds;
+	bool cached;
+	SearchStats stats;  // Of the worker thread that solved the level
+};
+
+/**
+ * Expand the given paths into a list of level files: files are taken as
+ * they are, directories contribute all regular files directly inside them
+ * (not starting with a dot), in name order.
+ */
+std::vector<std::string> batch_collect_levels(std::vector<std::string> &paths) {
+	std::vector<std::string> levels;
+	for(size_t i = 0; i < paths.size(); i++) {
+		struct stat info;
+		if(stat(paths[i].c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+			levels.push_back(paths[i]);
+			continue;
+		}
+		DIR *dir = opendir(paths[i].c_str());
+		if(!dir) {
+			continue;
+		}
+		std::vector<std::string> files;
+		struct dirent *entry;
+		while((entry = readdir(dir)) != NULL) {
+			if(entry->d_name[0] == '.') {
+				continue;
+			}
+			std::string file = paths[i] + "/" + entry->d_name;
+			if(stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+				files.push_back(file);
+			}
+		}
+		closedir(dir);
+		std::sort(files.begin(), files.end());
+		levels.insert(levels.end(), files.begin(), files.end());
+	}
+	return levels;
+}
+
+/**
+ * One level to solve: either a level file, which the worker loads itself, or
+ * a level already parsed from a collection.
+ */
+struct BatchJob {
+	std::string name;  // File name, or "file:N" for the Nth level of a collection
+	std::string title; // Title of a collection level
+	bool parsed;       // Whether board already holds the level
+	bool valid;        // Whether the collection level could be parsed
+	Game board;
+};
+
+/**
+ * Hands out the levels of a batch one by one. Collection files are parsed
+ * lazily, one level per call, so that solving starts right away even for
+ * collections of many thousand levels. Not thread-safe; callers lock.
+ */
+struct BatchSource {
+	std::vector<std::string> &paths;
+	size_t index;
+	LevelCollection collection;
+	bool in_collection;
+
+	BatchSource(std::vector<std::string> &paths) :
+		paths(paths), index(0), in_collection(false) {}
+
+	bool next(BatchJob *job) {
+		while(true) {
+			if(this->in_collection) {
+				job->board = Game();
+				job->board.board.fields = NULL;
+				int status = this->collection.next(&job->board, &job->title);
+				if(status != COLLECTION_END) {
+					job->name = this->paths[this->index] + ":"
+					            + std::to_string(this->collection.n_levels);
+					job->parsed = true;
+					job->valid = (status == COLLECTION_LEVEL);
+					return true;
+				}
+				this->collection.close();
+				this->in_collection = false;
+				this->index++;
+			}
+			if(this->index >= this->paths.size()) {
+				return false;
+			}
+			const std::string &path = this->paths[this->index];
+			if(is_collection_file(path.c_str()) && this->collection.open(path.c_str())) {
+				this->in_collection = true;
+				continue;
+			}
+			job->name = path;
+			job->title.clear();
+			job->parsed = false;
+			job->valid = true;
+			this->index++;
+			return true;
+		}
+	}
+};
+
+/**
+ * Search for a solution of board with the given heuristic, cost model and
+ * limits (with partial expansion if partial is set), and fill in the result
+ * (except for the time) and the moves of the solution. board.level must be
+ * set up by the caller if wanted.
+ */
+BatchResult solve_level(Game &board, Heuristic &heuristic, CostModel *cost,
+                        SearchLimits &limits, bool partial, std::string *moves) {
+	BatchResult result = {"error", 0, 0, 0, 0, false};
+	std::vector<State *> solution;
+	if(cost->push_graph()) {
+		PushGame start(board);
+		std::vector<State *> pushes = A_star(start, heuristic, false, cost, NULL, &limits, partial);
+		solution = expand_push_solution(board, pushes);
+		for(size_t i = 0; i < pushes.size(); i++) {
+			if(pushes[i] != &start) {
+				delete_state(pushes[i]);
+			}
+		}
+		delete[] start.board.fields;
+	} else {
+		solution = A_star(board, heuristic, false, cost, NULL, &limits, partial);
+	}
+
+	if(!solution.empty()) {
+		result.status = "solved";
+		result.moves = solution.size() - 1;
+		for(size_t i = 1; i < solution.size(); i++) {
+			Game *current = static_cast<Game *>(solution[i]);
+			result.pushes += current->edge_pushes(*static_cast<Game *>(solution[i-1]));
+		}
+	} else if(limits.timed_out) {
+		result.status = "timeout";
+	} else if(limits.out_of_memory) {
+		result.status = "memout";
+	} else if(limits.cancelled) {
+		result.status = "cancelled";
+	} else {
+		result.status = "unsolvable";
+	}
+	result.expansions = limits.n_expanded;
+	*moves = solution_to_moves(solution);
+	for(size_t i = 0; i < solution.size(); i++) {
+		if(solution[i] != &board) {
+			delete_state(solution[i]);
+		}
+	}
+	return result;
+}
+
+/**
+ * Whether a search ending with result was complete, so that the result
+ * holds for the level (and may be cached).
+ */
+bool result_is_final(BatchResult &result) {
+	return strcmp(result.status, "solved") == 0 || strcmp(result.status, "unsolvable") == 0;
+}
+
+/**
+ * Solve a single level. Everything the search needs (level analysis,
+ * heuristic, cost model) is created here, so that levels can be solved on
+ * several threads at once. The job's board is freed.
+ */
+BatchResult batch_solve(BatchJob &job, BatchOptions &options) {
+	TRACE_SPAN("solve level");
+	BatchResult result = {"error", 0, 0, 0, 0, false};
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	search_stats.reset(options.stats);
+	Game &board = job.board;
+	if(!job.parsed) {
+		board.board.fields = NULL;
+		job.valid = (board_from_file(job.name.c_str(), &board, options.old_fmt) == 0);
+	}
+	if(!job.valid) {
+		delete[] board.board.fields;
+		return result;
+	}
+	trim_board(board);
+	std::string key;
+	if(options.cache) {
+		key = cache_key(board, cache_objective((options.cost ? options.cost : "moves"),
+		                                       options.simple_heuristic, options.macros,
+		                                       options.corrals));
+		CacheEntry entry;
+		if(options.cache->lookup(key, &entry)) {
+			result.status = (entry.solved ? "solved" : "unsolvable");
+			result.moves = entry.moves.size();
+			result.pushes = entry.pushes;
+			result.expansions = entry.expansions;
+			result.cached = true;
+			delete[] board.board.fields;
+			result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+			return result;
+		}
+	}
+	CostModel *cost = (options.cost ? cost_model_from_name(options.cost) : new MoveCost());
+	assert(cost != NULL);
+	if(options.macros || options.corrals) {
+		board.level = analyze_level(board);
+		board.level->macros = options.macros;
+		board.level->corrals = options.corrals;
+	}
+	Heuristic *heuristic;
+	if(options.simple_heuristic) {
+		heuristic = new SimpleHeuristic();
+	} else {
+		heuristic = new MinCostHeuristic();
+	}
+	SearchLimits limits;
+	limits.started = started; // Parsing and setup count against the limit
+	limits.max_seconds = options.max_seconds;
+	limits.max_memory = options.max_memory;
+
+	std::string moves;
+	result = solve_level(board, *heuristic, cost, limits, options.partial, &moves);
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	result.stats = search_stats;
+	if(options.cache && result_is_final(result)) {
+		CacheEntry entry;
+		entry.solved = (strcmp(result.status, "solved") == 0);
+		entry.moves = moves;
+		entry.pushes = result.pushes;
+		entry.expansions = result.expansions;
+		entry.seconds = result.seconds;
+		options.cache->store(key, entry);
+	}
+	delete heuristic;
+	delete cost;
+	delete board.level;
+	delete[] board.board.fields;
+	return result;
+}
+
+/**
+ * Quote str as a JSON string literal.
+ */
+std::string json_string(const std::string &str) {
+	std::string out = "\"";
+	for(size_t i = 0; i < str.size(); i++) {
+		unsigned char c = str[i];
+		if(c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if(c < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			out += escaped;
+		} else {
+			out += c;
+		}
+	}
+	return out + "\"";
+}
+
+/**
+ * Write str to fp as a JSON string literal.
+ */
+void json_print_string(FILE *fp, const char *str) {
+	fputs(json_string(str).c_str(), fp);
+}
+
+/**
+ * Solve all levels on a pool of options.jobs threads. levels may contain
+ * level files and XSB/SOK collections (see collection.cpp), whose levels are
+ * solved individually. Prints one JSON line per level to stdout as soon as
+ * the level is done, so results arrive in the order levels finish, not in
+ * input order. Returns the number of levels solved; the number of levels
+ * attempted is stored in n_levels.
+ */
+int batch_run(std::vector<std::string> &levels, BatchOptions &options,
+              unsigned long *n_levels) {
+	BatchSource source(levels);
+	std::atomic<unsigned long> n_jobs(0);
+	std::mutex input;
+	std::atomic<int> n_solved(0);
+	std::mutex output;
+	std::vector<std::thread> workers;
+	for(int j = 0; j < std::max(options.jobs, 1); j++) {
+		workers.push_back(std::thread([&]() {
+			BatchJob job;
+			while(true) {
+				{
+					std::lock_guard<std::mutex> lock(input);
+					if(!source.next(&job)) {
+						break;
+					}
+				}
+				n_jobs++;
+				BatchResult result = batch_solve(job, options);
+				if(strcmp(result.status, "solved") == 0) {
+					n_solved++;
+				}
+				std::lock_guard<std::mutex> lock(output);
+				printf("{\"level\": ");
+				json_print_string(stdout, job.name.c_str());
+				if(!job.title.empty()) {
+					printf(", \"title\": ");
+					json_print_string(stdout, job.title.c_str());
+				}
+				printf(", \"status\": \"%s\", \"moves\": %lu, \"pushes\": %lu, "
+				       "\"expansions\": %lu, \"time\": %.3f",
+				       result.status, result.moves, result.pushes,
+				       result.expansions, result.seconds);
+				if(result.cached) {
+					printf(", \"cached\": true");
+				}
+				if(options.stats) {
+					printf(", \"stats\": %s", result.stats.json().c_str());
+				}
+				printf("}\n");
+				fflush(stdout);
+			}
+		}));
+	}
+	for(size_t j = 0; j < workers.size(); j++) {
+		workers[j].join();
+	}
+	*n_levels = n_jobs;
+	return n_solved;
+}
+
+#endif
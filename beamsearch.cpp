@@ -0,0 +1,198 @@
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "game.cpp"
+#include "search.cpp"
+#include "trace.cpp"
+
+#ifndef BEAMSEARCH_H
+#define BEAMSEARCH_H
+
+/** *************************************************************************
+ * Beam Search
+ * ************************************************************************** */
+
+/**
+ * A state generated for the next layer of the beam.
+ */
+struct BeamCandidate {
+	double h;
+	size_t hash;
+	unsigned int parent; // Index of parent in the previous layer
+	State *state;
+	bool operator<(const BeamCandidate &other) const {
+		if(this->h != other.h) {
+			return this->h < other.h;
+		}
+		return this->hash < other.hash;
+	}
+};
+
+/**
+ * What is kept of a layer once the search has moved past it: enough to find
+ * the path back to the start, and to find the way forward again by
+ * regenerating successors.
+ */
+struct BeamTrace {
+	unsigned int parent;
+	size_t hash;
+};
+
+bool beam_hash_less(const BeamCandidate &a, const BeamCandidate &b) {
+	return a.hash < b.hash;
+}
+
+/**
+ * Beam search: a breadth-first search that keeps only the width states with
+ * the lowest heuristic value in each layer. Finds (possibly long) solutions
+ * quickly on levels far too large for A*, using memory proportional to the
+ * width, plus a few bytes per kept state for the way back. Layers are kept in
+ * preallocated arrays; duplicates within a layer and states already in one
+ * of the two preceding layers (which catches walking back and forth) are
+ * dropped.
+ *
+ * Returns an empty vector if the beam dies out before a goal is found.
+ */
+std::vector<State *> beam_search(State &start, Heuristic &heuristic, size_t width,
+                                 bool verbose = true) {
+	TRACE_SPAN("beam search");
+	if(start.is_goal()) {
+		return std::vector<State *>(1, &start);
+	}
+	std::vector<State *> layer;
+	std::vector<BeamCandidate> candidates;
+	std::vector<std::vector<BeamTrace> > trace;
+	std::vector<size_t> recent[2]; // Sorted hashes of the last two layers
+	layer.reserve(width);
+	candidates.reserve(4 * width);
+	layer.push_back(&start);
+	trace.push_back(std::vector<BeamTrace>(1, BeamTrace()));
+	trace[0][0].parent = 0;
+	trace[0][0].hash = start.hash();
+	recent[0].push_back(start.hash());
+	int goal = -1;
+
+	while(!layer.empty() && goal == -1) {
+		candidates.clear();
+		for(size_t i = 0; i < layer.size() && goal == -1; i++) {
+			std::vector<State *> neighbors = layer[i]->get_neighbors();
+			for(size_t k = 0; k < neighbors.size(); k++) {
+				State *neighbor = neighbors[k];
+				BeamCandidate candidate;
+				candidate.hash = neighbor->hash();
+				candidate.parent = i;
+				candidate.state = neighbor;
+				candidate.h = INFINITY;
+				bool recently_seen = false;
+				for(int r = 0; r < 2; r++) {
+					recently_seen = recently_seen
+						|| std::binary_search(recent[r].begin(), recent[r].end(), candidate.hash);
+				}
+				if(goal == -1 && !recently_seen) {
+					candidate.h = evaluate(heuristic, *neighbor);
+				}
+				if(candidate.h == INFINITY) {
+					delete_state(neighbor);
+					continue;
+				}
+				if(neighbor->is_goal()) {
+					goal = candidates.size();
+				}
+				candidates.push_back(candidate);
+			}
+		}
+		if(goal != -1) {
+			// Only the goal is needed in the last layer.
+			std::swap(candidates[0], candidates[goal]);
+			for(size_t k = 1; k < candidates.size(); k++) {
+				delete_state(candidates[k].state);
+			}
+			candidates.resize(1);
+		}
+
+		// Remove duplicates within the layer.
+		std::sort(candidates.begin(), candidates.end(), beam_hash_less);
+		size_t n = 0;
+		for(size_t k = 0; k < candidates.size(); k++) {
+			bool duplicate = false;
+			for(size_t j = n; j > 0 && candidates[j-1].hash == candidates[k].hash; j--) {
+				if(*candidates[j-1].state == *candidates[k].state) {
+					duplicate = true;
+					break;
+				}
+			}
+			if(duplicate) {
+				delete_state(candidates[k].state);
+			} else {
+				candidates[n++] = candidates[k];
+			}
+		}
+		candidates.resize(n);
+
+		// Keep the best width candidates.
+		if(candidates.size() > width) {
+			std::nth_element(candidates.begin(), candidates.begin() + width, candidates.end());
+			for(size_t k = width; k < candidates.size(); k++) {
+				delete_state(candidates[k].state);
+			}
+			candidates.resize(width);
+		}
+
+		for(size_t i = 0; i < layer.size(); i++) {
+			if(layer[i] != &start) {
+				delete_state(layer[i]);
+			}
+		}
+		layer.clear();
+		std::swap(recent[0], recent[1]);
+		recent[0].clear();
+		trace.push_back(std::vector<BeamTrace>(candidates.size()));
+		double best = INFINITY;
+		for(size_t k = 0; k < candidates.size(); k++) {
+			layer.push_back(candidates[k].state);
+			recent[0].push_back(candidates[k].hash);
+			trace.back()[k].parent = candidates[k].parent;
+			trace.back()[k].hash = candidates[k].hash;
+			best = std::min(best, candidates[k].h);
+		}
+		std::sort(recent[0].begin(), recent[0].end());
+		if(verbose) {
+			fprintf(stderr, "Depth %lu: %lu states, best h = %f\n",
+			        trace.size() - 1, layer.size(), best);
+		}
+	}
+
+	std::vector<State *> out;
+	if(goal == -1) {
+		return out;
+	}
+	for(size_t i = 0; i < layer.size(); i++) {
+		delete_state(layer[i]);
+	}
+
+	// Follow the parent links back to the start, then replay the path
+	// forward by regenerating successors and matching hashes.
+	std::vector<unsigned int> path(trace.size());
+	path.back() = 0;
+	for(size_t d = trace.size() - 1; d > 0; d--) {
+		path[d-1] = trace[d][path[d]].parent;
+	}
+	out.push_back(&start);
+	for(size_t d = 1; d < trace.size(); d++) {
+		std::vector<State *> neighbors = out.back()->get_neighbors();
+		State *next = NULL;
+		for(size_t k = 0; k < neighbors.size(); k++) {
+			if(!next && neighbors[k]->hash() == trace[d][path[d]].hash) {
+				next = neighbors[k];
+			} else {
+				delete_state(neighbors[k]);
+			}
+		}
+		assert(next != NULL);
+		out.push_back(next);
+	}
+	return out;
+}
+
+#endif
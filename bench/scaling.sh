@@ -0,0 +1,121 @@
+#!/bin/sh
+#
+# Scaling benchmark: solves generated levels of growing board size and box
+# count with each solver configuration, and tabulates (and, if gnuplot is
+# installed, plots) time, expansions and memory. See "Benchmarks" in the
+# README.
+#
+# Usage: bench/scaling.sh [OUT_DIR]        (run from the sokoban directory)
+#
+# Two sweeps are run: board size (SIZES, square boards, SWEEP_BOXES boxes)
+# and box count (BOXES, boards of SWEEP_SIZE). Every point is the average
+# over LEVELS levels with seeds 1..LEVELS and DIFFICULTY pulls per box.
+# A level that is not solved within TIME_LIMIT seconds counts with the time
+# and expansions spent on it, so points beyond the limits are lower bounds.
+
+set -e
+
+SOKOBAN=${SOKOBAN:-./sokoban}
+OUT=${1:-bench/out}
+LEVELS=${LEVELS:-5}
+TIME_LIMIT=${TIME_LIMIT:-30}
+JOBS=${JOBS:-1}
+SIZES=${SIZES:-"8 10 12 14 16 18 20"}
+SWEEP_BOXES=${SWEEP_BOXES:-3}
+BOXES=${BOXES:-"1 2 3 4 5 6 7"}
+SWEEP_SIZE=${SWEEP_SIZE:-12}
+DIFFICULTY=${DIFFICULTY:-8}
+
+# Configurations: name and solver flags.
+CONFIGS="astar-mincost:
+astar-simple:-s
+push-mincost:-c pushes
+push-macros-corrals:-c pushes -m -i"
+
+if [ ! -x "$SOKOBAN" ]; then
+	echo "$SOKOBAN not found; run make sokoban first." >&2
+	exit 1
+fi
+mkdir -p "$OUT/levels"
+RESULTS="$OUT/results.csv"
+SUMMARY="$OUT/summary.csv"
+echo "sweep,config,size,boxes,level,status,time,expansions,bytes" > "$RESULTS"
+
+# run SWEEP SIZE BOXES: generate the levels of one point and solve them with
+# every configuration.
+run() {
+	levels="$OUT/levels/$2x$2-$3.xsb"
+	if ! "$SOKOBAN" --generate "$2x$2" --boxes "$3" --difficulty $(($3 * DIFFICULTY)) \
+	     --count "$LEVELS" > "$levels"; then
+		return
+	fi
+	echo "$CONFIGS" | while IFS=: read -r name flags; do
+		echo "$1: $2x$2, $3 boxes, $name" >&2
+		# shellcheck disable=SC2086
+		"$SOKOBAN" --batch "$levels" -j "$JOBS" --time-limit "$TIME_LIMIT" --stats=json $flags \
+		| sed -n 's/.*"level": "[^"]*:\([0-9]*\)".*"status": "\([a-z]*\)".*"expansions": \([0-9]*\), "time": \([0-9.]*\).*"bytes_stored": \([0-9]*\).*/\1,\2,\4,\3,\5/p' \
+		| sed "s/^/$1,$name,$2,$3,/" >> "$RESULTS"
+	done
+}
+
+for size in $SIZES; do
+	run size "$size" "$SWEEP_BOXES"
+done
+for boxes in $BOXES; do
+	run boxes "$SWEEP_SIZE" "$boxes"
+done
+
+# One line per sweep, configuration and point (x is the size or box count).
+awk -F, 'NR > 1 {
+	key = $1 "," $2 "," ($1 == "size" ? $3 : $4)
+	if(!(key in n)) {
+		keys[++k] = key
+	}
+	n[key]++
+	solved[key] += ($6 == "solved")
+	time[key] += $7
+	expansions[key] += $8
+	bytes[key] += $9
+}
+END {
+	print "sweep,config,x,levels,solved,time,expansions,bytes"
+	for(i = 1; i <= k; i++) {
+		key = keys[i]
+		printf "%s,%d,%d,%.3f,%.0f,%.0f\n", key, n[key], solved[key], time[key] / n[key],
+		       expansions[key] / n[key], bytes[key] / n[key]
+	}
+}' "$RESULTS" > "$SUMMARY"
+echo "Results in $RESULTS, averages in $SUMMARY." >&2
+
+if ! command -v gnuplot > /dev/null; then
+	echo "gnuplot not found, no plots drawn." >&2
+	exit 0
+fi
+for sweep in size boxes; do
+	for config in $(echo "$CONFIGS" | cut -d: -f1); do
+		grep "^$sweep,$config," "$SUMMARY" | tr , ' ' > "$OUT/$sweep-$config.dat"
+	done
+	if [ "$sweep" = size ]; then
+		label="Board width and height ($SWEEP_BOXES boxes)"
+	else
+		label="Boxes (${SWEEP_SIZE}x$SWEEP_SIZE board)"
+	fi
+	column=6
+	for metric in time expansions bytes; do
+		plots=""
+		for config in $(echo "$CONFIGS" | cut -d: -f1); do
+			plots="$plots${plots:+, }'$OUT/$sweep-$config.dat' using 3:$column with linespoints title '$config'"
+		done
+		gnuplot <<-EOF
+			set terminal png size 800,500
+			set output '$OUT/$sweep-$metric.png'
+			set xlabel '$label'
+			set ylabel 'Mean $metric per level'
+			set logscale y
+			set key top left
+			plot $plots
+		EOF
+		column=$((column + 1))
+	done
+done
+echo "Plots in $OUT/*.png." >&2
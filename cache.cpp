@@ -0,0 +1,378 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "game.cpp"
+
+#ifndef CACHE_H
+#define CACHE_H
+
+/** *************************************************************************
+ * Solution Cache
+ * ************************************************************************** */
+
+#define CACHE_MAGIC "SOKCACH1"
+#define CACHE_RECORD_MAGIC 0x524b4f53 // "SOKR"
+
+/**
+ * Canonical form of a level for use as a cache key: the board is cut down to
+ * the area the player can reach (boxes counting as floor) plus any boxes and
+ * goals elsewhere, surrounded by one layer of walls, and written out in XSB
+ * symbols, one row per line, after the objective (see cache_objective()).
+ * Everything outside that area becomes wall. Levels that only differ in how
+ * they were written down (input format, position on the board, exterior
+ * padding) therefore get the same key.
+ */
+std::string cache_key(Game &game, const std::string &objective) {
+	Board &board = game.board;
+	int width = board.dimensions.x, height = board.dimensions.y;
+	std::vector<bool> keep(width * height, false);
+	std::vector<Coord> stack(1, game.player);
+	keep[game.player.x + width * game.player.y] = true;
+	while(!stack.empty()) {
+		Coord pos = stack.back();
+		stack.pop_back();
+		for(int i = 0; i < 4; i++) {
+			Coord next = pos + actions[i];
+			if(next.x < 0 || next.y < 0 || next.x >= width || next.y >= height
+			   || keep[next.x + width * next.y] || board.get_field(next) == Board::wall) {
+				continue;
+			}
+			keep[next.x + width * next.y] = true;
+			stack.push_back(next);
+		}
+	}
+	Coord min(width, height), max(-1, -1);
+	for(int y = 0; y < height; y++) {
+		for(int x = 0; x < width; x++) {
+			Board::Field field = board.get_field(Coord(x, y));
+			if(field != Board::empty && field != Board::wall) {
+				keep[x + width * y] = true;
+			}
+			if(keep[x + width * y]) {
+				min = Coord(std::min(min.x, x), std::min(min.y, y));
+				max = Coord(std::max(max.x, x), std::max(max.y, y));
+			}
+		}
+	}
+	std::string key(objective);
+	for(int y = min.y - 1; y <= max.y + 1; y++) {
+		key += '\n';
+		for(int x = min.x - 1; x <= max.x + 1; x++) {
+			if(x < 0 || y < 0 || x >= width || y >= height || !keep[x + width * y]) {
+				key += '#';
+				continue;
+			}
+			Board::Field field = board.get_field(Coord(x, y));
+			bool player = (Coord(x, y) == game.player);
+			switch(field) {
+				case Board::box: key += '$'; break;
+				case Board::box_on_goal: key += '*'; break;
+				case Board::goal: key += (player ? '+' : '.'); break;
+				default: key += (player ? '@' : ' '); break;
+			}
+		}
+	}
+	return key;
+}
+
+/**
+ * The objective part of a cache key: the cost model name, followed by the
+ * flags of the options that can change the solution found (the heuristic,
+ * macros, corral pruning and learned deadlocks), so that results of one
+ * configuration are not served to another. Partial expansion only changes
+ * which of the optimal solutions is found and is left out.
+ */
+std::string cache_objective(const char *cost, bool simple_heuristic, bool macros, bool corrals,
+                            bool learn_deadlocks = false) {
+	std::string objective(cost);
+	if(simple_heuristic) {
+		objective += " -s";
+	}
+	if(macros) {
+		objective += " -m";
+	}
+	if(corrals) {
+		objective += " -i";
+	}
+	if(learn_deadlocks) {
+		objective += " -k";
+	}
+	return objective;
+}
+
+/**
+ * 64-bit FNV-1a hash.
+ */
+uint64_t cache_hash(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+	const unsigned char *bytes = (const unsigned char *)data;
+	for(size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+/**
+ * What the cache knows about a level: whether it is solvable, and if so the
+ * solution as a string of moves (LRUD), along with the statistics of the
+ * search that found it.
+ */
+struct CacheEntry {
+	bool solved;
+	std::string moves;
+	unsigned long pushes;
+	unsigned long expansions;
+	double seconds;
+};
+
+/**
+ * Header of a cache record. It is followed by the key, the value (the entry
+ * in text form) and a checksum over all of the above.
+ */
+struct CacheRecord {
+	uint32_t magic;
+	uint32_t key_size;
+	uint32_t value_size;
+	uint32_t reserved;
+	uint64_t key_hash;
+};
+
+/**
+ * An on-disk cache of solutions, keyed by cache_key(). The file is an
+ * append-only log of records, which is memory-mapped; the in-memory index
+ * maps key hashes to record offsets within the mapping, so a lookup compares
+ * the key in place and parses only the matching value. Entries are never
+ * changed; should a key be stored twice, the later record wins.
+ *
+ * Several processes (and threads) may use the same file at once. Records are
+ * appended with a single write under an exclusive flock(), and carry a
+ * checksum, so readers, which take no lock, stop at a record that is still
+ * being written and pick it up on their next refresh. A writer finding an
+ * incomplete record at the end (left by a process that died while writing)
+ * cuts it off before appending.
+ */
+struct SolutionCache {
+	int fd;
+	const char *data;
+	size_t mapped;   // Bytes mapped
+	size_t scanned;  // Bytes of complete records indexed
+	std::unordered_multimap<uint64_t, size_t> index;
+	std::mutex mutex;
+	unsigned long n_hits;
+	unsigned long n_misses;
+
+	SolutionCache() : fd(-1), data(NULL), mapped(0), scanned(0), n_hits(0), n_misses(0) {}
+
+	/**
+	 * Open (or create) the cache file. Returns false if it cannot be opened
+	 * or is not a cache file.
+	 */
+	bool open(const char *path) {
+		this->fd = ::open(path, O_RDWR | O_CREAT, 0644);
+		if(this->fd == -1) {
+			return false;
+		}
+		flock(this->fd, LOCK_EX);
+		struct stat info;
+		bool ok = (fstat(this->fd, &info) == 0);
+		if(ok && info.st_size == 0) {
+			ok = (write(this->fd, CACHE_MAGIC, 8) == 8);
+		}
+		char magic[8];
+		ok = ok && pread(this->fd, magic, 8, 0) == 8 && memcmp(magic, CACHE_MAGIC, 8) == 0;
+		flock(this->fd, LOCK_UN);
+		if(!ok) {
+			this->close();
+			return false;
+		}
+		this->scanned = 8;
+		this->refresh();
+		return true;
+	}
+
+	void close() {
+		if(this->data) {
+			munmap((void *)this->data, this->mapped);
+		}
+		if(this->fd != -1) {
+			::close(this->fd);
+		}
+		this->fd = -1;
+		this->data = NULL;
+		this->mapped = 0;
+		this->scanned = 0;
+		this->index.clear();
+	}
+
+	/**
+	 * Size of the complete record at offset, or 0 if there is none (yet).
+	 */
+	size_t record_at(size_t offset) {
+		if(offset + sizeof(CacheRecord) > this->mapped) {
+			return 0;
+		}
+		CacheRecord record;
+		memcpy(&record, this->data + offset, sizeof(record));
+		size_t size = sizeof(record) + (size_t)record.key_size + record.value_size + sizeof(uint64_t);
+		if(record.magic != CACHE_RECORD_MAGIC || offset + size > this->mapped) {
+			return 0;
+		}
+		uint64_t checksum;
+		memcpy(&checksum, this->data + offset + size - sizeof(checksum), sizeof(checksum));
+		if(checksum != cache_hash(this->data + offset, size - sizeof(checksum))) {
+			return 0;
+		}
+		return size;
+	}
+
+	/**
+	 * Map and index records appended since the last refresh.
+	 */
+	void refresh() {
+		struct stat info;
+		if(fstat(this->fd, &info) != 0 || (size_t)info.st_size == this->mapped) {
+			return;
+		}
+		if(this->data) {
+			munmap((void *)this->data, this->mapped);
+		}
+		this->mapped = info.st_size;
+		void *map = mmap(NULL, this->mapped, PROT_READ, MAP_SHARED, this->fd, 0);
+		if(map == MAP_FAILED) {
+			this->data = NULL;
+			this->mapped = 0;
+			this->scanned = 8;
+			this->index.clear();
+			return;
+		}
+		this->data = (const char *)map;
+		size_t size;
+		while((size = this->record_at(this->scanned)) != 0) {
+			CacheRecord record;
+			memcpy(&record, this->data + this->scanned, sizeof(record));
+			this->index.insert(std::make_pair(record.key_hash, this->scanned));
+			this->scanned += size;
+		}
+	}
+
+	/**
+	 * Find the latest record for key.
+	 */
+	bool find(const std::string &key, uint64_t hash, CacheEntry *entry) {
+		std::pair<std::unordered_multimap<uint64_t, size_t>::iterator,
+		          std::unordered_multimap<uint64_t, size_t>::iterator>
+			range = this->index.equal_range(hash);
+		size_t found = 0;
+		for(std::unordered_multimap<uint64_t, size_t>::iterator it = range.first;
+		    it != range.second; ++it) {
+			CacheRecord record;
+			memcpy(&record, this->data + it->second, sizeof(record));
+			if(record.key_size == key.size() && it->second > found
+			   && memcmp(this->data + it->second + sizeof(record), key.data(), key.size()) == 0) {
+				found = it->second;
+			}
+		}
+		if(!found) {
+			return false;
+		}
+		CacheRecord record;
+		memcpy(&record, this->data + found, sizeof(record));
+		std::string value(this->data + found + sizeof(record) + record.key_size, record.value_size);
+		int solved = 0, length = 0;
+		if(sscanf(value.c_str(), "%d %lu %lu %lf\n%n", &solved, &entry->pushes,
+		          &entry->expansions, &entry->seconds, &length) != 4 || !length) {
+			return false;
+		}
+		entry->solved = solved;
+		entry->moves = value.substr(length);
+		return true;
+	}
+
+	/**
+	 * Look up key; on a miss, records that other processes appended in the
+	 * meantime are indexed and looked at as well.
+	 */
+	bool lookup(const std::string &key, CacheEntry *entry) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		uint64_t hash = cache_hash(key.data(), key.size());
+		bool hit = this->find(key, hash, entry);
+		if(!hit) {
+			this->refresh();
+			hit = this->find(key, hash, entry);
+		}
+		(hit ? this->n_hits : this->n_misses)++;
+		return hit;
+	}
+
+	/**
+	 * Append an entry for key.
+	 */
+	bool store(const std::string &key, const CacheEntry &entry) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		char stats[128];
+		snprintf(stats, sizeof(stats), "%d %lu %lu %.6f\n", (int)entry.solved,
+		         entry.pushes, entry.expansions, entry.seconds);
+		std::string value = stats + entry.moves;
+		CacheRecord record;
+		record.magic = CACHE_RECORD_MAGIC;
+		record.key_size = key.size();
+		record.value_size = value.size();
+		record.reserved = 0;
+		record.key_hash = cache_hash(key.data(), key.size());
+		std::string buffer((const char *)&record, sizeof(record));
+		buffer += key;
+		buffer += value;
+		uint64_t checksum = cache_hash(buffer.data(), buffer.size());
+		buffer.append((const char *)&checksum, sizeof(checksum));
+
+		flock(this->fd, LOCK_EX);
+		this->refresh();
+		// Nobody else is writing now, so anything after the last complete
+		// record is left over from a crashed writer.
+		bool ok = (this->scanned == this->mapped || ftruncate(this->fd, this->scanned) == 0);
+		ok = ok && pwrite(this->fd, buffer.data(), buffer.size(), this->scanned)
+		           == (ssize_t)buffer.size();
+		flock(this->fd, LOCK_UN);
+		return ok;
+	}
+};
+
+/**
+ * The moves (LRUD) along a solution.
+ */
+std::string solution_to_moves(std::vector<State *> &solution) {
+	std::string moves;
+	for(size_t i = 1; i < solution.size(); i++) {
+		Game *from = static_cast<Game *>(solution[i-1]);
+		Game *to = static_cast<Game *>(solution[i]);
+		moves += action_char(to->player - from->player);
+	}
+	return moves;
+}
+
+/**
+ * Replay moves from start, giving the states along the way (start itself
+ * first; the others are newly allocated).
+ */
+std::vector<State *> moves_to_solution(Game &start, const std::string &moves) {
+	std::vector<State *> solution(1, &start);
+	Game *current = &start;
+	for(size_t i = 0; i < moves.size(); i++) {
+		Game *next = new Game(*current);
+		next->take_action(char_action(moves[i]));
+		solution.push_back(next);
+		current = next;
+	}
+	return solution;
+}
+
+#endif
@@ -0,0 +1,271 @@
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <ctime>
+#include <unistd.h>
+#include <vector>
+#include <unordered_map>
+#include "game.cpp"
+#include "pack.cpp"
+#include "cost.cpp"
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/** *************************************************************************
+ * Search Checkpoints
+ * ************************************************************************** */
+
+#define CHECKPOINT_MAGIC "SOKCKPT1"
+#define CHECKPOINT_BUFFER (1 << 20)
+
+/**
+ * Seconds between two commits (can be set at compile time), and number of
+ * iterations between looking at the clock.
+ */
+#ifndef CHECKPOINT_INTERVAL
+#define CHECKPOINT_INTERVAL 60
+#endif
+#define CHECKPOINT_CHECK_EVERY 1024
+
+/**
+ * Record types of the checkpoint log.
+ */
+#define CHECKPOINT_NEW      'N' // packed state, parent id, g
+#define CHECKPOINT_IMPROVED 'G' // id, parent id, g
+#define CHECKPOINT_EXPANDED 'X' // id
+#define CHECKPOINT_COMMIT   'C' // iteration
+
+/**
+ * A checkpoint of an A* search is an append-only log of everything the
+ * search learns: every newly generated state (packed, see pack.cpp) with its
+ * parent and g-value, every improvement of a g-value, and every expansion.
+ * States are numbered in the order they are first logged; the start state
+ * is number 0 and is stored in the header.
+ *
+ * Records go through a large stdio buffer as the search produces them, and
+ * every CHECKPOINT_INTERVAL seconds a commit record is written and the file
+ * is synced. A checkpoint therefore only costs writing what changed since
+ * the last one. On resume, the log is replayed up to the last commit (any
+ * incomplete tail is cut off); the closed table, g-values and parent links
+ * follow directly, and the open list consists of all states that were not
+ * expanded after they were last improved.
+ *
+ * Integers are stored in native byte order; checkpoints are meant to be
+ * resumed on the same kind of machine.
+ */
+struct Checkpoint {
+	const char *path;
+	FILE *fp;
+	char *buffer;
+	StatePacker packer;
+	std::unordered_map<State *, unsigned int> ids;
+	std::vector<unsigned char> record;
+	unsigned int n_states;
+	time_t last_commit;
+
+	/**
+	 * Search state restored by open(), indexed by state number. Handed over
+	 * to (and owned by) A_star, which clears these vectors.
+	 */
+	bool resumed;
+	unsigned long iteration;
+	std::vector<State *> states;
+	std::vector<unsigned int> parents;
+	std::vector<Cost> costs;
+	std::vector<bool> open_states;
+
+	Checkpoint(const char *path) :
+		path(path), fp(NULL), buffer(NULL), n_states(0), last_commit(0),
+		resumed(false), iteration(0) {}
+
+	/**
+	 * Open the checkpoint file for the search from start. With resume, an
+	 * existing checkpoint is loaded (if there is none, the search starts
+	 * from scratch); otherwise any existing file is overwritten. Returns
+	 * false if the file cannot be written or belongs to a different level.
+	 */
+	bool open(Game &start, bool resume) {
+		this->packer = StatePacker(start);
+		this->record.resize(this->packer.size);
+		this->packer.pack(start, &this->record[0]);
+		this->ids[&start] = 0;
+		this->n_states = 1;
+		this->fp = NULL;
+		if(resume) {
+			this->fp = fopen(this->path, "r+b");
+		}
+		if(this->fp) {
+			if(!this->load(start)) {
+				fclose(this->fp);
+				this->fp = NULL;
+				return false;
+			}
+		} else {
+			this->fp = fopen(this->path, "w+b");
+			if(!this->fp) {
+				return false;
+			}
+			unsigned int size = this->packer.size;
+			fwrite(CHECKPOINT_MAGIC, 1, 8, this->fp);
+			fwrite(&size, sizeof(size), 1, this->fp);
+			fwrite(&this->record[0], 1, size, this->fp);
+		}
+		this->buffer = new char[CHECKPOINT_BUFFER];
+		setvbuf(this->fp, this->buffer, _IOFBF, CHECKPOINT_BUFFER);
+		this->last_commit = time(NULL);
+		return true;
+	}
+
+	/**
+	 * Replay the log up to the last commit and truncate it there.
+	 */
+	bool load(Game &start) {
+		char magic[8];
+		unsigned int size = 0;
+		std::vector<unsigned char> packed(this->packer.size);
+		if(fread(magic, 1, 8, this->fp) != 8 || memcmp(magic, CHECKPOINT_MAGIC, 8) != 0
+		   || fread(&size, sizeof(size), 1, this->fp) != 1 || size != this->packer.size
+		   || fread(&packed[0], 1, size, this->fp) != size
+		   || memcmp(&packed[0], &this->record[0], size) != 0) {
+			return false;
+		}
+		long header_end = ftell(this->fp);
+
+		// First pass: find the end of the last commit.
+		long end = header_end;
+		unsigned long committed_iteration = 0;
+		int type;
+		while((type = fgetc(this->fp)) != EOF) {
+			long skip = 0;
+			if(type == CHECKPOINT_NEW) {
+				skip = size + sizeof(unsigned int) + sizeof(Cost);
+			} else if(type == CHECKPOINT_IMPROVED) {
+				skip = 2 * sizeof(unsigned int) + sizeof(Cost);
+			} else if(type == CHECKPOINT_EXPANDED) {
+				skip = sizeof(unsigned int);
+			} else if(type == CHECKPOINT_COMMIT) {
+				if(fread(&committed_iteration, sizeof(committed_iteration), 1, this->fp) != 1) {
+					break;
+				}
+				end = ftell(this->fp);
+				this->iteration = committed_iteration;
+				continue;
+			} else {
+				break;
+			}
+			if(fseek(this->fp, skip, SEEK_CUR) != 0) {
+				break;
+			}
+		}
+
+		// Second pass: rebuild the search state.
+		fseek(this->fp, header_end, SEEK_SET);
+		this->states.assign(1, &start);
+		this->parents.assign(1, 0);
+		this->costs.assign(1, 0);
+		this->open_states.assign(1, true);
+		while(ftell(this->fp) < end) {
+			type = fgetc(this->fp);
+			unsigned int id, parent;
+			Cost g;
+			if(type == CHECKPOINT_NEW) {
+				size_t read = fread(&packed[0], 1, size, this->fp);
+				read += fread(&parent, sizeof(parent), 1, this->fp);
+				read += fread(&g, sizeof(g), 1, this->fp);
+				assert(read == size + 2);
+				Game *state = start.copy();
+				this->packer.unpack_into(*state, &packed[0]);
+				this->ids[state] = this->states.size();
+				this->states.push_back(state);
+				this->parents.push_back(parent);
+				this->costs.push_back(g);
+				this->open_states.push_back(true);
+			} else if(type == CHECKPOINT_IMPROVED) {
+				size_t read = fread(&id, sizeof(id), 1, this->fp);
+				read += fread(&parent, sizeof(parent), 1, this->fp);
+				read += fread(&g, sizeof(g), 1, this->fp);
+				assert(read == 3 && id < this->states.size());
+				this->parents[id] = parent;
+				this->costs[id] = g;
+				this->open_states[id] = true;
+			} else if(type == CHECKPOINT_EXPANDED) {
+				size_t read = fread(&id, sizeof(id), 1, this->fp);
+				assert(read == 1 && id < this->states.size());
+				this->open_states[id] = false;
+			} else {
+				assert(type == CHECKPOINT_COMMIT);
+				fseek(this->fp, sizeof(unsigned long), SEEK_CUR);
+			}
+		}
+		this->n_states = this->states.size();
+		this->resumed = true;
+
+		// Cut off the incomplete tail and continue appending.
+		fflush(this->fp);
+		int truncated = ftruncate(fileno(this->fp), end);
+		assert(truncated == 0);
+		fseek(this->fp, end, SEEK_SET);
+		return true;
+	}
+
+	/**
+	 * Log that state was reached from parent with the given g-value, either
+	 * for the first time or on a cheaper path.
+	 */
+	void generated(State *state, State *parent, Cost g) {
+		unsigned int parent_id = this->ids[parent];
+		std::unordered_map<State *, unsigned int>::iterator it = this->ids.find(state);
+		if(it == this->ids.end()) {
+			this->ids[state] = this->n_states++;
+			this->packer.pack(*static_cast<Game *>(state), &this->record[0]);
+			fputc(CHECKPOINT_NEW, this->fp);
+			fwrite(&this->record[0], 1, this->packer.size, this->fp);
+		} else {
+			fputc(CHECKPOINT_IMPROVED, this->fp);
+			fwrite(&it->second, sizeof(it->second), 1, this->fp);
+		}
+		fwrite(&parent_id, sizeof(parent_id), 1, this->fp);
+		fwrite(&g, sizeof(g), 1, this->fp);
+	}
+
+	/**
+	 * Log that state was taken from the open list and expanded.
+	 */
+	void expanded(State *state) {
+		unsigned int id = this->ids[state];
+		fputc(CHECKPOINT_EXPANDED, this->fp);
+		fwrite(&id, sizeof(id), 1, this->fp);
+	}
+
+	/**
+	 * Called once per iteration, between expansions; commits if the last
+	 * commit is long enough ago.
+	 */
+	void tick(unsigned long iteration) {
+		if(iteration % CHECKPOINT_CHECK_EVERY == 0
+		   && time(NULL) - this->last_commit >= CHECKPOINT_INTERVAL) {
+			this->commit(iteration);
+		}
+	}
+
+	void commit(unsigned long iteration) {
+		fputc(CHECKPOINT_COMMIT, this->fp);
+		fwrite(&iteration, sizeof(iteration), 1, this->fp);
+		fflush(this->fp);
+		fsync(fileno(this->fp));
+		this->last_commit = time(NULL);
+	}
+
+	void close() {
+		if(this->fp) {
+			fclose(this->fp);
+		}
+		delete[] this->buffer;
+		this->fp = NULL;
+		this->buffer = NULL;
+	}
+
+};
+
+#endif
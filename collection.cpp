@@ -0,0 +1,297 @@
+#include <cstring>
+#include <cctype>
+#include <strings.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "game.cpp"
+#include "io.cpp"
+#include "trace.cpp"
+
+#ifndef COLLECTION_H
+#define COLLECTION_H
+
+/** *************************************************************************
+ * Level Collections (XSB/SOK)
+ * ************************************************************************** */
+
+/**
+ * Results of LevelCollection::next.
+ */
+#define COLLECTION_END     0
+#define COLLECTION_LEVEL   1
+#define COLLECTION_INVALID 2
+
+/**
+ * Is the character one of the XSB board symbols? '-' and '_' are accepted
+ * as alternative floor symbols.
+ */
+bool is_xsb_char(char c) {
+	return c == '#' || c == ' ' || c == '@' || c == '+' || c == '$' || c == '*'
+	       || c == '.' || c == '-' || c == '_';
+}
+
+/**
+ * A line belongs to a board if it consists of board symbols only and holds
+ * at least one wall.
+ */
+bool is_xsb_line(const char *line, size_t len) {
+	bool wall = false;
+	for(size_t i = 0; i < len; i++) {
+		if(!is_xsb_char(line[i])) {
+			return false;
+		}
+		wall = wall || line[i] == '#';
+	}
+	return wall;
+}
+
+/**
+ * Does the line look like a "Key: value" metadata line?
+ */
+bool is_key_line(const char *line, size_t len) {
+	size_t i = 0;
+	while(i < len && (isalnum((unsigned char)line[i]) || line[i] == ' ')) {
+		i++;
+	}
+	return i > 0 && i < len && line[i] == ':';
+}
+
+/**
+ * Does the file name suggest a collection in XSB/SOK format?
+ */
+bool is_collection_file(const char *path) {
+	const char *ext = strrchr(path, '.');
+	return ext && (strcasecmp(ext, ".xsb") == 0 || strcasecmp(ext, ".sok") == 0);
+}
+
+/**
+ * A file of levels in the common XSB/SOK format:
+ *
+ *     ; Level 1
+ *     #####
+ *     #@$.#
+ *     #####
+ *     Title: Tiny
+ *
+ * with '#' wall, '@' player, '+' player on goal, '$' box, '*' box on goal,
+ * '.' goal and ' ', '-' or '_' floor. Levels are separated by any line that
+ * is not part of a board. A level's title is taken from a "Title:" line
+ * following the board, or else from the last other text line before it
+ * (without a leading ';').
+ *
+ * The file is memory-mapped and parsed one level at a time by next(), so
+ * that levels can be handed to the solver while the rest of the file has
+ * not been looked at yet. Board lines are read in place; the only copy made
+ * is the board of the level itself.
+ */
+struct LevelCollection {
+	const char *data;
+	size_t size;
+	size_t pos;
+	int fd;
+	unsigned int n_levels; // Number of levels returned so far
+
+	LevelCollection() : data(NULL), size(0), pos(0), fd(-1), n_levels(0) {}
+
+	bool open(const char *path) {
+		this->fd = ::open(path, O_RDONLY);
+		if(this->fd == -1) {
+			return false;
+		}
+		struct stat info;
+		if(fstat(this->fd, &info) != 0) {
+			this->close();
+			return false;
+		}
+		this->size = info.st_size;
+		this->pos = 0;
+		this->n_levels = 0;
+		if(this->size == 0) {
+			return true;
+		}
+		void *map = mmap(NULL, this->size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+		if(map == MAP_FAILED) {
+			this->close();
+			return false;
+		}
+		madvise(map, this->size, MADV_SEQUENTIAL);
+		this->data = (const char *)map;
+		return true;
+	}
+
+	/**
+	 * Read levels from a buffer in memory instead of a file. The buffer must
+	 * stay valid while the collection is used.
+	 */
+	void open_memory(const char *data, size_t size) {
+		this->close();
+		this->data = data;
+		this->size = size;
+		this->n_levels = 0;
+	}
+
+	void close() {
+		if(this->data && this->fd != -1) {
+			munmap((void *)this->data, this->size);
+		}
+		if(this->fd != -1) {
+			::close(this->fd);
+		}
+		this->data = NULL;
+		this->fd = -1;
+		this->size = 0;
+		this->pos = 0;
+	}
+
+	/**
+	 * Get the line starting at pos: its start, its length without line
+	 * break, and the position of the next line.
+	 */
+	const char *line_at(size_t pos, size_t *len, size_t *next) {
+		const char *start = this->data + pos;
+		const char *end = (const char *)memchr(start, '\n', this->size - pos);
+		*next = (end ? end - this->data + 1 : this->size);
+		if(!end) {
+			end = this->data + this->size;
+		}
+		*len = end - start;
+		if(*len > 0 && start[*len - 1] == '\r') {
+			(*len)--;
+		}
+		return start;
+	}
+
+	/**
+	 * Parse the next level into board (whose fields are newly allocated)
+	 * and its title. Returns COLLECTION_LEVEL, COLLECTION_END if there are
+	 * no more levels, or COLLECTION_INVALID if the level does not have
+	 * exactly one player (board is left untouched then).
+	 */
+	int next(Game *board, std::string *title) {
+		TRACE_SPAN("parse level");
+		size_t len, next;
+		const char *line;
+		title->clear();
+
+		// Skip to the first board line, remembering a possible title.
+		while(this->pos < this->size) {
+			line = this->line_at(this->pos, &len, &next);
+			if(is_xsb_line(line, len)) {
+				break;
+			}
+			size_t skip = 0;
+			while(skip < len && (line[skip] == ';' || line[skip] == ' ' || line[skip] == '\t')) {
+				skip++;
+			}
+			if(skip < len && !is_key_line(line, len)) {
+				title->assign(line + skip, len - skip);
+			}
+			this->pos = next;
+		}
+		if(this->pos >= this->size) {
+			return COLLECTION_END;
+		}
+
+		// Board lines.
+		std::vector<std::pair<const char *, size_t> > rows;
+		size_t width = 0;
+		while(this->pos < this->size) {
+			line = this->line_at(this->pos, &len, &next);
+			if(!is_xsb_line(line, len)) {
+				break;
+			}
+			rows.push_back(std::make_pair(line, len));
+			width = std::max(width, len);
+			this->pos = next;
+		}
+
+		// Metadata after the board, up to a blank line or the next level.
+		while(this->pos < this->size) {
+			line = this->line_at(this->pos, &len, &next);
+			if(len == 0 || is_xsb_line(line, len) || !is_key_line(line, len)) {
+				break;
+			}
+			if(len > 6 && strncasecmp(line, "Title:", 6) == 0) {
+				size_t skip = 6;
+				while(skip < len && line[skip] == ' ') {
+					skip++;
+				}
+				title->assign(line + skip, len - skip);
+			}
+			this->pos = next;
+		}
+		this->n_levels++;
+
+		int n_players = 0;
+		Coord player;
+		for(size_t y = 0; y < rows.size(); y++) {
+			for(size_t x = 0; x < rows[y].second; x++) {
+				char c = rows[y].first[x];
+				if(c == '@' || c == '+') {
+					n_players++;
+					player = Coord(x, y);
+				}
+			}
+		}
+		if(n_players != 1) {
+			return COLLECTION_INVALID;
+		}
+		Board::Field *fields = new Board::Field[width * rows.size()]();
+		for(size_t y = 0; y < rows.size(); y++) {
+			for(size_t x = 0; x < rows[y].second; x++) {
+				Board::Field &field = fields[x + width * y];
+				switch(rows[y].first[x]) {
+					case '#': field = Board::wall; break;
+					case '$': field = Board::box; break;
+					case '*': field = Board::box_on_goal; break;
+					case '.': case '+': field = Board::goal; break;
+					default: field = Board::empty; break;
+				}
+			}
+		}
+		board->player = player;
+		board->board.dimensions = Coord(width, rows.size());
+		board->board.fields = fields;
+		return COLLECTION_LEVEL;
+	}
+
+};
+
+/**
+ * Parse a level given as text in the given format, guessing the format if
+ * it is "auto": XSB if there is a player symbol of that format, the list of
+ * coordinates if the text starts with a digit, the visual format otherwise.
+ * Returns 0 on success, 1 if the level cannot be parsed.
+ */
+int board_from_text(std::string text, const std::string &format, Game *board) {
+	std::string kind = format;
+	if(kind == "auto") {
+		size_t first = text.find_first_not_of(" \t\r\n");
+		if(text.find_first_of("@+") != std::string::npos) {
+			kind = "xsb";
+		} else if(first != std::string::npos && isdigit((unsigned char)text[first])) {
+			kind = "coords";
+		} else {
+			kind = "visual";
+		}
+	}
+	board->board.fields = NULL;
+	if(kind == "xsb") {
+		LevelCollection collection;
+		collection.open_memory(text.data(), text.size());
+		std::string title;
+		return (collection.next(board, &title) == COLLECTION_LEVEL ? 0 : 1);
+	} else if(kind == "coords") {
+		return board_from_new_fmt_string(&text[0], board);
+	} else if(kind == "visual") {
+		return board_from_string(&text[0], board);
+	}
+	return 1;
+}
+
+#endif
@@ -0,0 +1,416 @@
+#include <cstdio>
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <chrono>
+#include "game.cpp"
+#include "search.cpp"
+#include "pack.cpp"
+#include "progress.cpp"
+#include "trace.cpp"
+
+#ifndef COMPACTSEARCH_H
+#define COMPACTSEARCH_H
+
+/** *************************************************************************
+ * Compact-Memory A* Search
+ * ************************************************************************** */
+
+/**
+ * Every COMPACT_ANCHOR_INTERVAL moves along a path, a node keeps its full
+ * (packed) state; all other nodes are rebuilt from the closest such anchor
+ * above them by replaying at most that many moves. Larger intervals save
+ * memory and cost time.
+ */
+#ifndef COMPACT_ANCHOR_INTERVAL
+#define COMPACT_ANCHOR_INTERVAL 16
+#endif
+
+/**
+ * Nodes are allocated in blocks of this many, so that the node store never
+ * has to be copied as it grows.
+ */
+#define COMPACT_BLOCK_BITS 16
+#define COMPACT_BLOCK (1 << COMPACT_BLOCK_BITS)
+
+#define COMPACT_EMPTY 0xffffffffu
+
+/**
+ * A node of the compact search: 16 bytes, instead of a full board per state.
+ * Only the move that led to it from its parent is kept; the state itself is
+ * rebuilt when the node is expanded (see CompactSearch::restore). Nodes are
+ * told apart by their fingerprint, a 64-bit hash of the state.
+ */
+struct CompactNode {
+	unsigned long long fingerprint;
+	unsigned int parent;     // Index of the node this one was reached from
+	unsigned int g : 28;     // Moves from the start
+	unsigned int move : 2;   // Index into actions of the move from the parent
+	unsigned int anchor : 1; // Full state kept in CompactSearch::anchor_states
+	unsigned int closed : 1; // Expanded (or unsolvable); not on the open list
+};
+
+/**
+ * Open list entry. Among entries with equal f, the later node (which tends
+ * to be the deeper one) comes first.
+ */
+struct CompactEntry {
+	unsigned int f;
+	unsigned int node;
+
+	CompactEntry(unsigned int f, unsigned int node) : f(f), node(node) {}
+
+	bool operator<(const CompactEntry &other) const {
+		if(this->f != other.f) {
+			return this->f > other.f;
+		}
+		return this->node < other.node;
+	}
+};
+
+/**
+ * A* over the move graph that stores states delta-encoded. The search keeps,
+ * per state:
+ *
+ * - a CompactNode (16 bytes): parent, move, g and fingerprint;
+ * - a slot in an open-addressing table of node indices keyed by fingerprint
+ *   (4 bytes per slot, at most 3/4 full);
+ * - on average a 1/COMPACT_ANCHOR_INTERVAL share of a packed anchor state.
+ *
+ * That is about 25 bytes plus the open list, against a full board copy and
+ * several hash table entries per state in A_star, so that hundreds of
+ * millions of states fit into the memory of one machine. The price is the
+ * replay of up to COMPACT_ANCHOR_INTERVAL moves per expansion.
+ *
+ * Duplicates are detected by fingerprint alone. Two different states with
+ * the same fingerprint are taken for one, with a chance of about n^2 / 2^65
+ * for n states (one in 3000 for 10^8 states); the search may then miss the
+ * optimal solution, but never returns an invalid one, as states are only
+ * ever rebuilt by replaying legal moves. A node whose moves no longer apply
+ * after such a collision is dropped.
+ *
+ * Only the number of moves is minimized.
+ */
+struct CompactSearch {
+	Heuristic &heuristic;
+	bool verbose;
+	SearchLimits *limits;
+
+	StatePacker packer;
+	std::vector<CompactNode *> blocks;
+	unsigned long n_nodes;
+	std::vector<unsigned int> table;      // Node indices by fingerprint
+	std::vector<unsigned int> anchor_nodes; // Indices of the anchor nodes, ascending
+	std::vector<unsigned char> anchor_states; // Their packed states, in the same order
+	std::priority_queue<CompactEntry> todo;
+	std::vector<unsigned char> replay;    // Moves being replayed by restore()
+	unsigned long n_dropped;
+
+	CompactSearch(Game &start, Heuristic &heuristic, bool verbose, SearchLimits *limits) :
+		heuristic(heuristic), verbose(verbose), limits(limits), packer(start), n_nodes(0),
+		table(1024, COMPACT_EMPTY), n_dropped(0) {}
+
+	~CompactSearch() {
+		for(size_t i = 0; i < this->blocks.size(); i++) {
+			delete[] this->blocks[i];
+		}
+	}
+
+	CompactNode &node(unsigned int index) {
+		return this->blocks[index >> COMPACT_BLOCK_BITS][index & (COMPACT_BLOCK - 1)];
+	}
+
+	/**
+	 * Bytes used by the search's tables.
+	 */
+	size_t memory() {
+		return this->blocks.size() * COMPACT_BLOCK * sizeof(CompactNode)
+		       + this->table.size() * sizeof(unsigned int)
+		       + this->anchor_nodes.size() * sizeof(unsigned int) + this->anchor_states.size()
+		       + this->todo.size() * sizeof(CompactEntry);
+	}
+
+	/**
+	 * 64-bit hash of a state: player and box bits (as in PackedKey), mixed
+	 * word by word and finalized so that every bit depends on every box.
+	 */
+	unsigned long long fingerprint(Game &state) {
+		CellIndex &cells = this->packer.cells;
+		unsigned long long hash = (unsigned int)state.board.get_index(state.player)
+		                          * 0x9e3779b97f4a7c15ULL;
+		unsigned long long word = 0;
+		for(int c = 0; c < cells.n_cells; c++) {
+			Board::Field field = state.board.fields[cells.field[c]];
+			if(field == Board::box || field == Board::box_on_goal) {
+				word |= 1ULL << (c % 64);
+			}
+			if(c % 64 == 63 || c == cells.n_cells - 1) {
+				hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+				hash ^= hash >> 32;
+				word = 0;
+			}
+		}
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53ULL;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	/**
+	 * The table slot holding the node with the given fingerprint, or the
+	 * empty slot where it belongs (linear probing).
+	 */
+	unsigned int *slot(unsigned long long fingerprint) {
+		size_t mask = this->table.size() - 1;
+		size_t i = fingerprint & mask;
+		while(this->table[i] != COMPACT_EMPTY
+		      && this->node(this->table[i]).fingerprint != fingerprint) {
+			i = (i + 1) & mask;
+		}
+		return &this->table[i];
+	}
+
+	/**
+	 * Double the table once it is 3/4 full.
+	 */
+	void grow_table() {
+		if(4 * this->n_nodes < 3 * this->table.size()) {
+			return;
+		}
+		std::vector<unsigned int> old(2 * this->table.size(), COMPACT_EMPTY);
+		old.swap(this->table);
+		for(size_t i = 0; i < old.size(); i++) {
+			if(old[i] != COMPACT_EMPTY) {
+				*this->slot(this->node(old[i]).fingerprint) = old[i];
+			}
+		}
+	}
+
+	/**
+	 * Append a node for state, which is an anchor if anchor is set. Returns
+	 * its index, or COMPACT_EMPTY if the node store is full.
+	 */
+	unsigned int add(Game &state, unsigned long long fingerprint, unsigned int parent,
+	                 unsigned int g, int move, bool anchor) {
+		if(this->n_nodes >= COMPACT_EMPTY) {
+			return COMPACT_EMPTY;
+		}
+		unsigned int index = this->n_nodes++;
+		if((index & (COMPACT_BLOCK - 1)) == 0) {
+			this->blocks.push_back(new CompactNode[COMPACT_BLOCK]);
+		}
+		CompactNode &node = this->node(index);
+		node.fingerprint = fingerprint;
+		node.parent = parent;
+		node.g = g;
+		node.move = move;
+		node.anchor = anchor;
+		node.closed = false;
+		if(anchor) {
+			this->anchor_nodes.push_back(index);
+			size_t offset = this->anchor_states.size();
+			this->anchor_states.resize(offset + this->packer.size);
+			this->packer.pack(state, &this->anchor_states[offset]);
+		}
+		*this->slot(fingerprint) = index;
+		this->grow_table();
+		return index;
+	}
+
+	/**
+	 * Rebuild the state of node index into state (a board of the level's
+	 * dimensions) by replaying the moves from the closest anchor above it.
+	 * Stores the number of moves replayed in *distance. Returns false if a
+	 * move does not apply, which only a fingerprint collision can cause.
+	 */
+	bool restore(unsigned int index, Game &state, int *distance) {
+		this->replay.clear();
+		while(!this->node(index).anchor) {
+			this->replay.push_back(this->node(index).move);
+			index = this->node(index).parent;
+		}
+		size_t a = std::lower_bound(this->anchor_nodes.begin(), this->anchor_nodes.end(), index)
+		           - this->anchor_nodes.begin();
+		this->packer.unpack_into(state, &this->anchor_states[a * this->packer.size]);
+		for(size_t i = this->replay.size(); i-- > 0;) {
+			Coord action = actions[this->replay[i]];
+			if(!state.is_action_legal(action)) {
+				return false;
+			}
+			state.take_action(action);
+		}
+		*distance = this->replay.size();
+		return true;
+	}
+
+	/**
+	 * The states from start to the goal node, start itself first.
+	 */
+	std::vector<State *> path(Game &start, unsigned int goal) {
+		std::vector<unsigned char> moves;
+		for(unsigned int index = goal; index != 0; index = this->node(index).parent) {
+			moves.push_back(this->node(index).move);
+		}
+		std::vector<State *> out;
+		out.push_back(&start);
+		Game *current = &start;
+		for(size_t i = moves.size(); i-- > 0;) {
+			Game *next = new Game(*current);
+			next->take_action(actions[moves[i]]);
+			out.push_back(next);
+			current = next;
+		}
+		return out;
+	}
+
+	std::vector<State *> run(Game &start) {
+		SearchLimits *limits = this->limits;
+		std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+		double h0 = evaluate(this->heuristic, start);
+		this->add(start, this->fingerprint(start), 0, 0, 0, true);
+		if(h0 != INFINITY) {
+			this->todo.push(CompactEntry(cost_from_heuristic(h0), 0));
+		}
+		Game state(start);
+		std::vector<State *> neighbors;
+		double best = h0;
+		unsigned int best_node = 0;
+		unsigned long iteration = 0;
+		SearchProgress *reporter = (this->verbose ? new SearchProgress(stderr) : NULL);
+		unsigned int goal = COMPACT_EMPTY;
+
+		while(!this->todo.empty()) {
+			iteration++;
+			int distance;
+			if(reporter && reporter->due(iteration) && this->restore(best_node, state, &distance)) {
+				reporter->report(state, best, iteration, this->todo.size(), this->n_nodes);
+			}
+			size_t memory = this->memory();
+			search_stats.bytes_stored = memory;
+			if(limits && limits->max_memory && memory > limits->max_memory) {
+				limits->out_of_memory = true;
+				break;
+			}
+			if(limits && limits->out_of_time()) {
+				limits->timed_out = true;
+				break;
+			}
+			if(limits && limits->cancel && *limits->cancel) {
+				limits->cancelled = true;
+				break;
+			}
+			if(limits && limits->progress && iteration % SEARCH_PROGRESS_EVERY == 0
+			   && !limits->progress(limits->progress_data, iteration,
+			           std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count())) {
+				limits->cancelled = true;
+				break;
+			}
+			search_stats.open_peak = std::max(search_stats.open_peak, (unsigned long)this->todo.size());
+			unsigned int index = this->todo.top().node;
+			this->todo.pop();
+			if(this->node(index).closed) {
+				continue; // Expanded since it was queued
+			}
+			this->node(index).closed = true;
+			if(!this->restore(index, state, &distance)) {
+				this->n_dropped++;
+				continue;
+			}
+			if(state.is_goal()) {
+				goal = index;
+				break;
+			}
+			search_stats.expanded++;
+			unsigned int g = this->node(index).g + 1;
+			neighbors.clear();
+			state.expand(neighbors);
+			search_stats.generated += neighbors.size();
+			for(std::vector<State *>::iterator it = neighbors.begin(); it != neighbors.end(); ++it) {
+				Game *successor = static_cast<Game *>(*it);
+				int move = 0;
+				while(!(state.player + actions[move] == successor->player)) {
+					move++;
+				}
+				unsigned long long fingerprint = this->fingerprint(*successor);
+				unsigned int found = *this->slot(fingerprint);
+				unsigned int neighbor = found;
+				double h;
+				if(found != COMPACT_EMPTY) {
+					search_stats.duplicates++;
+					CompactNode &node = this->node(found);
+					if(g >= node.g) {
+						delete_state(successor);
+						continue;
+					}
+					search_stats.reopened++;
+					node.parent = index;
+					node.g = g;
+					node.move = move;
+					node.closed = false;
+					h = evaluate(this->heuristic, *successor);
+				} else {
+					h = evaluate(this->heuristic, *successor);
+					neighbor = this->add(*successor, fingerprint, index, g, move,
+					                     distance + 1 >= COMPACT_ANCHOR_INTERVAL);
+					if(neighbor == COMPACT_EMPTY) {
+						delete_state(successor);
+						continue;
+					}
+				}
+				if(h == INFINITY) {
+					search_stats.pruned_heuristic++;
+					this->node(neighbor).closed = true; // Kept to recognize it again
+				} else {
+					if(h <= best) {
+						best = h;
+						best_node = neighbor;
+					}
+					this->todo.push(CompactEntry(g + cost_from_heuristic(h), neighbor));
+				}
+				delete_state(successor);
+			}
+		}
+
+		if(limits) {
+			limits->n_expanded = iteration;
+		}
+		if(reporter) {
+			int distance;
+			if(this->restore(goal != COMPACT_EMPTY ? goal : best_node, state, &distance)) {
+				reporter->report(state, best, iteration, this->todo.size(), this->n_nodes);
+			}
+			delete reporter;
+		}
+		if(this->verbose) {
+			fprintf(stderr, "Compact search: %lu nodes, %lu anchors, %.1f bytes per node",
+			        this->n_nodes, (unsigned long)this->anchor_nodes.size(),
+			        (double)this->memory() / std::max(this->n_nodes, 1UL));
+			if(this->n_dropped) {
+				fprintf(stderr, ", %lu dropped after fingerprint collisions", this->n_dropped);
+			}
+			fprintf(stderr, ".\n");
+		}
+		delete[] state.board.fields;
+		if(goal == COMPACT_EMPTY) {
+			return std::vector<State *>();
+		}
+		TRACE_SPAN("reconstruct path");
+		return this->path(start, goal);
+	}
+};
+
+/**
+ * A* search that stores states delta-encoded (see CompactSearch), for
+ * levels whose search does not fit into memory with full states. Minimizes
+ * moves; honours time and memory limits like A_star.
+ */
+std::vector<State *> compact_A_star(Game &start, Heuristic &heuristic, bool verbose = true,
+                                    SearchLimits *limits = NULL) {
+	TRACE_SPAN("compact search");
+	CompactSearch search(start, heuristic, verbose, limits);
+	return search.run(start);
+}
+
+#endif
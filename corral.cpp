@@ -0,0 +1,170 @@
+#include <vector>
+#include "game.cpp"
+
+#ifndef CORRAL_H
+#define CORRAL_H
+
+/** *************************************************************************
+ * PI-Corral Pruning
+ * ************************************************************************** */
+
+/**
+ * A corral is an area of free fields the player cannot reach. Its border
+ * boxes are the boxes next to it.
+ *
+ * A corral is a PI-corral if
+ *  - (I) every push of a border box that is possible right now moves the box
+ *    into the corral, and
+ *  - (P) every push of a border box into the corral can be made right now,
+ *    i.e. the player can reach the field behind the box. A box the player
+ *    cannot get to yet, or that stands between two corrals, can be pushed in
+ *    only after other pushes, so it makes the corral no PI-corral.
+ *
+ * If a PI-corral is not yet solved (it contains a box not on a goal or an
+ * empty goal), it has to be entered eventually, and nothing the player does
+ * elsewhere can make that easier. It is therefore safe to consider only the
+ * pushes of its border boxes.
+ *
+ * find_pi_corral looks for the unsolved PI-corral with the fewest possible
+ * pushes. If there is one, movable is set for its border boxes (indexed by
+ * row-major board index) and true is returned.
+ */
+bool find_pi_corral(Game &game, std::vector<bool> &reach, std::vector<bool> &movable) {
+	Board &board = game.board;
+	int w = board.dimensions.x;
+	int h = board.dimensions.y;
+	int n = w * h;
+	std::vector<int> area(n, -1);
+	std::vector<int> todo;
+	int n_areas = 0;
+
+	// Label the corrals (connected unreachable free fields).
+	for(int i = 0; i < n; i++) {
+		Board::Field field = board.fields[i];
+		if(reach[i] || area[i] != -1 || (field != Board::empty && field != Board::goal)) {
+			continue;
+		}
+		area[i] = n_areas;
+		todo.push_back(i);
+		while(!todo.empty()) {
+			int j = todo.back();
+			todo.pop_back();
+			for(int a = 0; a < 4; a++) {
+				int x = j % w + actions[a].x;
+				int y = j / w + actions[a].y;
+				if(x < 0 || y < 0 || x >= w || y >= h) {
+					continue;
+				}
+				int k = x + w * y;
+				Board::Field next = board.fields[k];
+				if(area[k] != -1 || (next != Board::empty && next != Board::goal)) {
+					continue;
+				}
+				area[k] = n_areas;
+				todo.push_back(k);
+			}
+		}
+		n_areas++;
+	}
+	if(n_areas == 0) {
+		return false;
+	}
+
+	// Per corral: is it still a PI-corral, is it solved, number of pushes.
+	std::vector<bool> pi(n_areas, true);
+	std::vector<bool> solved(n_areas, true);
+	std::vector<int> n_pushes(n_areas, 0);
+	for(int i = 0; i < n; i++) {
+		if(board.fields[i] == Board::goal && area[i] != -1) {
+			solved[area[i]] = false;
+		}
+	}
+	for(int i = 0; i < n; i++) {
+		Board::Field field = board.fields[i];
+		if(field != Board::box && field != Board::box_on_goal) {
+			continue;
+		}
+		int x = i % w;
+		int y = i / w;
+		std::vector<int> touched; // Corrals next to this box
+		for(int a = 0; a < 4; a++) {
+			int nx = x + actions[a].x;
+			int ny = y + actions[a].y;
+			if(nx < 0 || ny < 0 || nx >= w || ny >= h) {
+				continue;
+			}
+			int k = nx + w * ny;
+			if(area[k] != -1) {
+				touched.push_back(area[k]);
+			}
+		}
+		for(size_t t = 0; t < touched.size(); t++) {
+			if(field == Board::box) {
+				solved[touched[t]] = false;
+			}
+		}
+		// Check conditions I and P for every corral the box touches, also if
+		// the player cannot get next to it yet: another push may let the
+		// player behind it.
+		for(int a = 0; a < 4; a++) {
+			int fx = x - actions[a].x, fy = y - actions[a].y;
+			int tx = x + actions[a].x, ty = y + actions[a].y;
+			if(fx < 0 || fy < 0 || tx < 0 || ty < 0 || fx >= w || tx >= w
+			   || fy >= h || ty >= h) {
+				continue;
+			}
+			int from = fx + w * fy;
+			int to = tx + w * ty;
+			Board::Field target = board.fields[to];
+			if(target != Board::empty && target != Board::goal) {
+				continue;
+			}
+			for(size_t t = 0; t < touched.size(); t++) {
+				int c = touched[t];
+				if(reach[from] && area[to] != c) {
+					pi[c] = false; // Violates I
+				} else if(area[to] != c || area[from] == c
+				          || board.fields[from] == Board::wall) {
+					continue; // Not a push into the corral
+				} else if(!reach[from]) {
+					pi[c] = false; // Violates P
+				} else {
+					n_pushes[c]++;
+				}
+			}
+		}
+	}
+
+	int best = -1;
+	for(int c = 0; c < n_areas; c++) {
+		if(!pi[c] || solved[c] || n_pushes[c] == 0) {
+			continue;
+		}
+		if(best == -1 || n_pushes[c] < n_pushes[best]) {
+			best = c;
+		}
+	}
+	if(best == -1) {
+		return false;
+	}
+	movable.assign(n, false);
+	for(int i = 0; i < n; i++) {
+		if(area[i] != best) {
+			continue;
+		}
+		for(int a = 0; a < 4; a++) {
+			int x = i % w + actions[a].x;
+			int y = i / w + actions[a].y;
+			if(x < 0 || y < 0 || x >= w || y >= h) {
+				continue;
+			}
+			Board::Field field = board.fields[x + w * y];
+			if(field == Board::box || field == Board::box_on_goal) {
+				movable[x + w * y] = true;
+			}
+		}
+	}
+	return true;
+}
+
+#endif
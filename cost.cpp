@@ -0,0 +1,131 @@
+#include <cstring>
+#include <cmath>
+#include "game.cpp"
+
+#ifndef COST_H
+#define COST_H
+
+/** *************************************************************************
+ * Cost Models
+ * ************************************************************************** */
+
+/**
+ * Path costs are unsigned integers. Lexicographic objectives pack their
+ * primary criterion into the upper and their secondary criterion into the
+ * lower 32 bits, so that the open list can order nodes with a single integer
+ * comparison and costs can simply be added along a path.
+ */
+typedef unsigned long long Cost;
+
+#define COST_PACK(primary, secondary) (((Cost)(primary) << 32) | (Cost)(secondary))
+
+/**
+ * Priority used for states the heuristic deems unsolvable. Leaves enough
+ * headroom that adding path costs to it cannot overflow.
+ */
+#define COST_INFINITY (1ULL << 62)
+
+/**
+ * A cost model defines the objective A* optimizes: the cost of a single
+ * transition, and how a heuristic estimate translates into a (lower bound
+ * on the) remaining cost.
+ */
+struct CostModel {
+	virtual ~CostModel() {}
+	virtual Cost step(State &from, State &to) = 0;
+	virtual Cost estimate(double h) = 0;
+	/**
+	 * Whether the objective ignores player moves, in which case the search
+	 * can run on the (much smaller) graph of pushes.
+	 */
+	virtual bool push_graph() { return false; }
+};
+
+/**
+ * Convert a heuristic value to an integer cost, mapping unsolvable states to
+ * COST_INFINITY.
+ */
+Cost cost_from_heuristic(double h) {
+	if(h == INFINITY || h >= COST_INFINITY) {
+		return COST_INFINITY;
+	}
+	return (Cost)lround(h);
+}
+
+/**
+ * Minimize the number of player moves (the original objective).
+ */
+struct MoveCost : CostModel {
+	Cost step(State &from, State &to) {
+		return static_cast<Game &>(to).edge_moves(static_cast<Game &>(from));
+	}
+	Cost estimate(double h) {
+		return cost_from_heuristic(h);
+	}
+};
+
+/**
+ * Minimize the number of box pushes; player moves are free.
+ */
+struct PushCost : CostModel {
+	Cost step(State &from, State &to) {
+		return static_cast<Game &>(to).edge_pushes(static_cast<Game &>(from));
+	}
+	Cost estimate(double h) {
+		return cost_from_heuristic(h);
+	}
+	bool push_graph() {
+		return true;
+	}
+};
+
+/**
+ * Minimize pushes, then moves among all push-optimal solutions.
+ */
+struct PushMoveCost : CostModel {
+	Cost step(State &from, State &to) {
+		Game &f = static_cast<Game &>(from);
+		Game &t = static_cast<Game &>(to);
+		return COST_PACK(t.edge_pushes(f), t.edge_moves(f));
+	}
+	Cost estimate(double h) {
+		// The heuristics bound the number of pushes, and every push is
+		// also a move, so the same value bounds both criteria.
+		Cost c = cost_from_heuristic(h);
+		return c == COST_INFINITY ? c : COST_PACK(c, c);
+	}
+};
+
+/**
+ * Minimize moves, then pushes among all move-optimal solutions.
+ */
+struct MovePushCost : CostModel {
+	Cost step(State &from, State &to) {
+		Game &f = static_cast<Game &>(from);
+		Game &t = static_cast<Game &>(to);
+		return COST_PACK(t.edge_moves(f), t.edge_pushes(f));
+	}
+	Cost estimate(double h) {
+		Cost c = cost_from_heuristic(h);
+		return c == COST_INFINITY ? c : COST_PACK(c, c);
+	}
+};
+
+/**
+ * Look up a cost model by its command line name. Returns NULL if the name is
+ * unknown.
+ */
+CostModel *cost_model_from_name(const char *name) {
+	if(0 == strcmp(name, "moves")) {
+		return new MoveCost();
+	} else if(0 == strcmp(name, "pushes")) {
+		return new PushCost();
+	} else if(0 == strcmp(name, "pushes-moves")) {
+		return new PushMoveCost();
+	} else if(0 == strcmp(name, "moves-pushes")) {
+		return new MovePushCost();
+	}
+	return NULL;
+}
+
+#endif
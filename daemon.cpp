@@ -0,0 +1,551 @@
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "game.cpp"
+#include "io.cpp"
+#include "search.cpp"
+#include "heuristic.cpp"
+#include "mincostheuristic.cpp"
+#include "cost.cpp"
+#include "level.cpp"
+#include "collection.cpp"
+#include "cache.cpp"
+#include "batch.cpp"
+#include "trace.cpp"
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+/** *************************************************************************
+ * Solver Daemon
+ * ************************************************************************** */
+
+/**
+ * Largest level text accepted in a request, and number of levels whose
+ * precomputed tables are kept between requests.
+ */
+#define DAEMON_MAX_LEVEL (1 << 20)
+#define DAEMON_TABLES 64
+
+/**
+ * A connection. Lines are read by the I/O thread only; responses are written
+ * by the workers, one whole line at a time.
+ */
+struct DaemonClient {
+	int fd;
+	std::string input;
+	std::mutex output;
+
+	DaemonClient(int fd) : fd(fd) {}
+
+	void send(const std::string &line) {
+		std::lock_guard<std::mutex> lock(this->output);
+		size_t sent = 0;
+		while(sent < line.size()) {
+			ssize_t n = ::send(this->fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+			if(n <= 0) {
+				return; // Client has gone away
+			}
+			sent += n;
+		}
+	}
+};
+
+/**
+ * A solve request. The level text is collected by the I/O thread; once it is
+ * complete, the request is queued for the workers.
+ */
+struct DaemonRequest {
+	std::string id;
+	std::shared_ptr<DaemonClient> client;
+	std::string level;
+	std::string format; // auto, xsb, coords or visual
+	std::string cost;
+	BatchOptions options;
+	std::atomic<bool> cancel;
+
+	DaemonRequest() : cancel(false) {}
+};
+
+/**
+ * Precomputed data of a level kept between requests: the heuristic (whose
+ * tables are built on first use) and the level analysis.
+ */
+struct DaemonTables {
+	std::string key;
+	Heuristic *heuristic;
+	Level *level;
+};
+
+/**
+ * Daemon mode: a long-lived process that solves levels sent to it over a
+ * Unix domain socket, so that clients do not pay for starting a process,
+ * and levels sent again do not pay for the heuristic's precomputation.
+ *
+ * The protocol is line-based. A client sends
+ *
+ *     solve ID [format=auto|xsb|coords|visual] [cost=COST] [heuristic=simple|mincost]
+ *              [macros] [corrals] [time=SEC] [mem=SIZE]
+ *     ...level text...
+ *     .
+ *
+ * to submit a level (the level ends with a line holding a single dot), and
+ *
+ *     cancel ID
+ *
+ * to give up on a request. Options not given default to those the daemon
+ * was started with. Any number of requests may be outstanding; each is
+ * answered with one JSON line once it is done, in the order they finish:
+ *
+ *     {"id": "ID", "status": "solved", "moves": 4, "pushes": 1, "expansions": 5,
+ *      "time": 0.001, "solution": "LURD"}
+ *
+ * status is one of those of batch mode, or "cancelled". IDs are chosen by
+ * the client and only need to be unique among its outstanding requests.
+ *
+ * Requests are solved by a fixed pool of worker threads. The tables of the
+ * DAEMON_TABLES levels solved last are kept; a table is used by one request
+ * at a time, so the same level solved twice at once gets a second one.
+ */
+struct Daemon {
+	const char *path;
+	BatchOptions &defaults;
+	int listen_fd;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<std::shared_ptr<DaemonRequest> > queue;
+	std::map<std::pair<DaemonClient *, std::string>, std::shared_ptr<DaemonRequest> > active;
+	std::list<DaemonTables> tables; // Most recently used first
+	bool stopping;
+	unsigned long n_requests;
+
+	Daemon(const char *path, BatchOptions &defaults) :
+		path(path), defaults(defaults), listen_fd(-1), stopping(false), n_requests(0) {}
+
+	/**
+	 * Create the socket (replacing a stale one). Returns false on failure.
+	 */
+	bool listen() {
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if(strlen(this->path) >= sizeof(address.sun_path)) {
+			return false;
+		}
+		strcpy(address.sun_path, this->path);
+		this->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(this->listen_fd == -1) {
+			return false;
+		}
+		unlink(this->path);
+		if(bind(this->listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0
+		   || ::listen(this->listen_fd, 16) != 0) {
+			close(this->listen_fd);
+			this->listen_fd = -1;
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * Send a response for request.
+	 */
+	void respond(DaemonRequest &request, BatchResult &result, const std::string &moves,
+	             const char *message = NULL) {
+		std::string line = "{\"id\": " + json_string(request.id)
+		                   + ", \"status\": \"" + result.status + "\"";
+		if(message) {
+			line += ", \"message\": " + json_string(message);
+		} else {
+			char stats[160];
+			snprintf(stats, sizeof(stats), ", \"moves\": %lu, \"pushes\": %lu, "
+			         "\"expansions\": %lu, \"time\": %.3f", result.moves,
+			         result.pushes, result.expansions, result.seconds);
+			line += stats;
+			if(result.cached) {
+				line += ", \"cached\": true";
+			}
+			line += ", \"solution\": \"" + moves + "\"";
+		}
+		line += "}\n";
+		request.client->send(line);
+	}
+
+	/**
+	 * Take the tables for board out of the list, or make new ones.
+	 */
+	DaemonTables checkout(Game &board, BatchOptions &options) {
+		int n = board.board.dimensions.x * board.board.dimensions.y;
+		std::string key((const char *)board.board.fields, n * sizeof(Board::Field));
+		char extra[64];
+		snprintf(extra, sizeof(extra), "|%d %d %d %d|%d%d%d", board.board.dimensions.x,
+		         board.board.dimensions.y, board.player.x, board.player.y,
+		         options.simple_heuristic, options.macros, options.corrals);
+		key += extra;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			for(std::list<DaemonTables>::iterator it = this->tables.begin();
+			    it != this->tables.end(); ++it) {
+				if(it->key == key) {
+					DaemonTables tables = *it;
+					this->tables.erase(it);
+					return tables;
+				}
+			}
+		}
+		DaemonTables tables;
+		tables.key = key;
+		if(options.simple_heuristic) {
+			tables.heuristic = new SimpleHeuristic();
+		} else {
+			tables.heuristic = new MinCostHeuristic();
+		}
+		tables.level = NULL;
+		if(options.macros || options.corrals) {
+			tables.level = analyze_level(board);
+			tables.level->macros = options.macros;
+			tables.level->corrals = options.corrals;
+		}
+		return tables;
+	}
+
+	/**
+	 * Put tables back for the next request, dropping the least recently
+	 * used ones if there are too many.
+	 */
+	void checkin(DaemonTables &tables) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->tables.push_front(tables);
+		while(this->tables.size() > DAEMON_TABLES) {
+			delete this->tables.back().heuristic;
+			delete this->tables.back().level;
+			this->tables.pop_back();
+		}
+	}
+
+	void solve(DaemonRequest &request) {
+		TRACE_SPAN("solve request");
+		std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+		BatchOptions &options = request.options;
+		BatchResult result = {"error", 0, 0, 0, 0, false};
+		std::string moves;
+		if(request.cancel) {
+			result.status = "cancelled";
+			this->respond(request, result, moves);
+			return;
+		}
+		Game board;
+		if(board_from_text(request.level, request.format, &board) != 0) {
+			delete[] board.board.fields;
+			this->respond(request, result, moves, "cannot parse level");
+			return;
+		}
+		trim_board(board);
+		std::string key;
+		CacheEntry entry;
+		if(options.cache) {
+			key = cache_key(board, cache_objective(request.cost.c_str(), options.simple_heuristic,
+			                                       options.macros, options.corrals));
+		}
+		if(options.cache && options.cache->lookup(key, &entry)) {
+			result.status = (entry.solved ? "solved" : "unsolvable");
+			result.moves = entry.moves.size();
+			result.pushes = entry.pushes;
+			result.expansions = entry.expansions;
+			result.cached = true;
+			moves = entry.moves;
+		} else {
+			CostModel *cost = cost_model_from_name(request.cost.c_str());
+			DaemonTables tables = this->checkout(board, options);
+			board.level = tables.level;
+			SearchLimits limits;
+			limits.started = started;
+			limits.max_seconds = options.max_seconds;
+			limits.max_memory = options.max_memory;
+			limits.cancel = &request.cancel;
+			result = solve_level(board, *tables.heuristic, cost, limits, options.partial, &moves);
+			this->checkin(tables);
+			delete cost;
+			if(options.cache && result_is_final(result)) {
+				entry.solved = (strcmp(result.status, "solved") == 0);
+				entry.moves = moves;
+				entry.pushes = result.pushes;
+				entry.expansions = result.expansions;
+				entry.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+				options.cache->store(key, entry);
+			}
+		}
+		delete[] board.board.fields;
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+		this->respond(request, result, moves);
+	}
+
+	void worker() {
+		while(true) {
+			std::shared_ptr<DaemonRequest> request;
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				while(this->queue.empty() && !this->stopping) {
+					this->wake.wait(lock);
+				}
+				if(this->stopping) {
+					return;
+				}
+				request = this->queue.front();
+				this->queue.pop_front();
+			}
+			this->solve(*request);
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->active.erase(std::make_pair(request->client.get(), request->id));
+		}
+	}
+
+	/**
+	 * Send an error for a malformed command.
+	 */
+	void reject(std::shared_ptr<DaemonClient> &client, const std::string &id, const char *message) {
+		DaemonRequest request;
+		request.id = id;
+		request.client = client;
+		BatchResult result = {"error", 0, 0, 0, 0, false};
+		this->respond(request, result, "", message);
+	}
+
+	/**
+	 * Handle one command line; returns a request whose level text follows,
+	 * if any.
+	 */
+	std::shared_ptr<DaemonRequest> command(std::shared_ptr<DaemonClient> &client,
+	                                       const std::string &line) {
+		std::vector<std::string> words;
+		size_t start = 0;
+		while((start = line.find_first_not_of(" \t\r", start)) != std::string::npos) {
+			size_t end = line.find_first_of(" \t\r", start);
+			words.push_back(line.substr(start, end - start));
+			start = end;
+		}
+		std::shared_ptr<DaemonRequest> none;
+		if(words.empty()) {
+			return none;
+		}
+		if(words.size() < 2 || (words[0] != "solve" && words[0] != "cancel")) {
+			this->reject(client, "", "unknown command");
+			return none;
+		}
+		if(words[0] == "cancel") {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			std::map<std::pair<DaemonClient *, std::string>, std::shared_ptr<DaemonRequest> >::iterator
+				it = this->active.find(std::make_pair(client.get(), words[1]));
+			if(it != this->active.end()) {
+				it->second->cancel = true;
+			}
+			return none;
+		}
+		std::shared_ptr<DaemonRequest> request(new DaemonRequest());
+		request->id = words[1];
+		request->client = client;
+		request->format = "auto";
+		request->options = this->defaults;
+		request->cost = (this->defaults.cost ? this->defaults.cost : "moves");
+		for(size_t i = 2; i < words.size(); i++) {
+			std::string name = words[i].substr(0, words[i].find('='));
+			std::string value = (name.size() < words[i].size() ? words[i].substr(name.size() + 1) : "");
+			BatchOptions &options = request->options;
+			if(name == "format") {
+				request->format = value;
+			} else if(name == "cost") {
+				request->cost = value;
+			} else if(name == "heuristic" && (value == "simple" || value == "mincost")) {
+				options.simple_heuristic = (value == "simple");
+			} else if(name == "macros") {
+				options.macros = true;
+			} else if(name == "corrals") {
+				options.corrals = true;
+			} else if(name == "time" && atof(value.c_str()) > 0) {
+				options.max_seconds = atof(value.c_str());
+			} else if(name == "mem" && parse_size(value.c_str())) {
+				options.max_memory = parse_size(value.c_str());
+			} else {
+				this->reject(client, request->id, "invalid option");
+				request->format = ""; // Read the level, but drop it
+			}
+		}
+		CostModel *cost = cost_model_from_name(request->cost.c_str());
+		if(!request->format.empty() && (!cost
+		   || ((request->options.macros || request->options.corrals) && !cost->push_graph()))) {
+			this->reject(client, request->id, cost ? "macros and corrals require cost=pushes"
+			                                       : "unknown cost model");
+			request->format = "";
+		}
+		delete cost;
+		return request;
+	}
+
+	/**
+	 * Process the complete lines a client has sent.
+	 */
+	void receive(std::shared_ptr<DaemonClient> &client,
+	             std::shared_ptr<DaemonRequest> &pending) {
+		size_t start = 0, end;
+		while((end = client->input.find('\n', start)) != std::string::npos) {
+			std::string line = client->input.substr(start, end - start);
+			start = end + 1;
+			if(!pending) {
+				pending = this->command(client, line);
+				continue;
+			}
+			if(line != "." && line != ".\r") {
+				if(pending->level.size() + line.size() < DAEMON_MAX_LEVEL) {
+					pending->level += line + '\n';
+				} else if(!pending->format.empty()) {
+					this->reject(client, pending->id, "level too large");
+					pending->format = "";
+				}
+				continue;
+			}
+			if(!pending->format.empty()) {
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->active[std::make_pair(client.get(), pending->id)] = pending;
+				this->queue.push_back(pending);
+				this->n_requests++;
+				this->wake.notify_one();
+			}
+			pending.reset();
+		}
+		client->input.erase(0, start);
+	}
+
+	/**
+	 * Cancel all requests of a client that has disconnected.
+	 */
+	void disconnect(DaemonClient *client) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::map<std::pair<DaemonClient *, std::string>, std::shared_ptr<DaemonRequest> >::iterator it;
+		for(it = this->active.begin(); it != this->active.end(); ++it) {
+			if(it->first.first == client) {
+				it->second->cancel = true;
+			}
+		}
+	}
+
+	/**
+	 * Serve requests until stop is set (by a signal). Returns 0 on a clean
+	 * shutdown.
+	 */
+	int run(int jobs, volatile sig_atomic_t *stop, bool verbose) {
+		std::vector<std::thread> workers;
+		for(int j = 0; j < std::max(jobs, 1); j++) {
+			workers.push_back(std::thread(&Daemon::worker, this));
+		}
+		std::vector<std::shared_ptr<DaemonClient> > clients;
+		std::vector<std::shared_ptr<DaemonRequest> > pending;
+		char buffer[1 << 16];
+		while(!*stop) {
+			std::vector<struct pollfd> fds(clients.size() + 1);
+			fds[0].fd = this->listen_fd;
+			fds[0].events = POLLIN;
+			for(size_t i = 0; i < clients.size(); i++) {
+				fds[i+1].fd = clients[i]->fd;
+				fds[i+1].events = POLLIN;
+			}
+			// The timeout catches signals delivered to a worker thread.
+			if(poll(&fds[0], fds.size(), 1000) <= 0) {
+				continue;
+			}
+			for(size_t i = clients.size(); i > 0; i--) {
+				if(!fds[i].revents) {
+					continue;
+				}
+				ssize_t n = read(clients[i-1]->fd, buffer, sizeof(buffer));
+				if(n > 0) {
+					clients[i-1]->input.append(buffer, n);
+					this->receive(clients[i-1], pending[i-1]);
+					continue;
+				}
+				this->disconnect(clients[i-1].get());
+				// Workers may still hold the client; it is closed with the
+				// last reference.
+				shutdown(clients[i-1]->fd, SHUT_RDWR);
+				clients.erase(clients.begin() + (i-1));
+				pending.erase(pending.begin() + (i-1));
+			}
+			if(fds[0].revents & POLLIN) {
+				int fd = accept(this->listen_fd, NULL, NULL);
+				if(fd != -1) {
+					clients.push_back(std::shared_ptr<DaemonClient>(new DaemonClient(fd),
+						[](DaemonClient *client) {
+							close(client->fd);
+							delete client;
+						}));
+					pending.push_back(std::shared_ptr<DaemonRequest>());
+				}
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->stopping = true;
+			for(std::map<std::pair<DaemonClient *, std::string>, std::shared_ptr<DaemonRequest> >::iterator
+			    it = this->active.begin(); it != this->active.end(); ++it) {
+				it->second->cancel = true;
+			}
+			this->wake.notify_all();
+		}
+		for(size_t j = 0; j < workers.size(); j++) {
+			workers[j].join();
+		}
+		for(std::list<DaemonTables>::iterator it = this->tables.begin(); it != this->tables.end(); ++it) {
+			delete it->heuristic;
+			delete it->level;
+		}
+		close(this->listen_fd);
+		unlink(this->path);
+		if(verbose) {
+			fprintf(stderr, "Served %lu requests.\n", this->n_requests);
+		}
+		return 0;
+	}
+};
+
+volatile sig_atomic_t daemon_stop = 0;
+
+void daemon_signal(int) {
+	daemon_stop = 1;
+}
+
+/**
+ * Run the daemon on the socket at path until SIGINT or SIGTERM.
+ */
+int daemon_run(const char *path, BatchOptions &defaults, bool verbose) {
+	Daemon daemon(path, defaults);
+	if(!daemon.listen()) {
+		fprintf(stderr, "Cannot listen on %s.\n", path);
+		return 1;
+	}
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = daemon_signal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	if(verbose) {
+		fprintf(stderr, "Listening on %s with %d workers.\n", path, defaults.jobs);
+	}
+	return daemon.run(defaults.jobs, &daemon_stop, verbose);
+}
+
+#endif
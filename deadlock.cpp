@@ -0,0 +1,392 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <set>
+#include <unordered_set>
+#include <algorithm>
+#include <functional>
+#include "game.cpp"
+#include "level.cpp"
+
+#ifndef DEADLOCK_H
+#define DEADLOCK_H
+
+/** *************************************************************************
+ * Learned Deadlock Patterns
+ * ************************************************************************** */
+
+/**
+ * Database of deadlock patterns learned during search.
+ *
+ * Whenever a push leaves a box next to other boxes, the cluster of boxes
+ * around it is checked with a small, bounded sub-search in which all other
+ * boxes are removed from the board. If, from every area the player might be
+ * in, no sequence of pushes gets every box of the cluster onto a goal or any
+ * of them out of a small window around the pushed box, the cluster can never
+ * be resolved -- adding boxes back only adds obstacles. Its box fields are
+ * then stored as a pattern (sorted row-major field indices; walls and goals
+ * are implied by the level), and any later state containing boxes on all of
+ * those fields is pruned without search. Patterns are indexed by field, so a
+ * new successor is only matched against patterns containing the field of the
+ * box that was just pushed.
+ *
+ * Clusters for which the sub-search did not prove a deadlock (or ran out of
+ * nodes) are remembered by hash, so each is examined only once.
+ */
+struct DeadlockDB {
+	Board base;                      // Walls and goals only
+	int max_boxes;                   // Largest cluster examined
+	int radius;                      // Sub-search window around pushed box
+	unsigned long node_limit;        // Sub-search budget per player area
+	std::vector<std::vector<int> > patterns;
+	std::vector<std::vector<int> > by_field; // Field -> ids of patterns
+	std::unordered_set<size_t> cleared;
+	unsigned long n_searches;
+	unsigned long n_hits;
+
+	DeadlockDB(Game &start) :
+		base(start.board),
+		max_boxes(4),
+		radius(3),
+		node_limit(2000),
+		n_searches(0),
+		n_hits(0) {
+		int n = this->n_fields();
+		for(int i = 0; i < n; i++) {
+			if(this->base.fields[i] == Board::box) {
+				this->base.fields[i] = Board::empty;
+			} else if(this->base.fields[i] == Board::box_on_goal) {
+				this->base.fields[i] = Board::goal;
+			}
+		}
+		this->by_field.resize(n);
+	}
+
+	int n_fields() {
+		return this->base.dimensions.x * this->base.dimensions.y;
+	}
+
+	bool is_wall(int x, int y) {
+		return x < 0 || y < 0 || x >= this->base.dimensions.x
+		       || y >= this->base.dimensions.y
+		       || this->base.get_field(Coord(x, y)) == Board::wall;
+	}
+
+	bool is_goal(int i) {
+		return this->base.fields[i] == Board::goal;
+	}
+
+	/**
+	 * Checksum of walls and goals, used to tell whether a pattern file
+	 * belongs to the current level.
+	 */
+	unsigned long checksum() {
+		unsigned long sum = 5381;
+		int n = this->n_fields();
+		for(int i = 0; i < n; i++) {
+			sum = sum * 33 + this->base.fields[i];
+		}
+		return sum;
+	}
+
+	void add(std::vector<int> &pattern) {
+		int id = this->patterns.size();
+		this->patterns.push_back(pattern);
+		for(size_t k = 0; k < pattern.size(); k++) {
+			this->by_field[pattern[k]].push_back(id);
+		}
+	}
+
+	/**
+	 * Does a known pattern containing the given field match the state?
+	 */
+	bool match(Game &game, int field) {
+		std::vector<int> &ids = this->by_field[field];
+		for(size_t k = 0; k < ids.size(); k++) {
+			std::vector<int> &pattern = this->patterns[ids[k]];
+			bool all = true;
+			for(size_t j = 0; j < pattern.size() && all; j++) {
+				Board::Field f = game.board.fields[pattern[j]];
+				all = (f == Board::box || f == Board::box_on_goal);
+			}
+			if(all) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Collect the boxes (8-)connected to the box on field, up to max_boxes.
+	 * The result is sorted.
+	 */
+	void cluster(Game &game, int field, std::vector<int> &boxes) {
+		int w = this->base.dimensions.x;
+		boxes.clear();
+		boxes.push_back(field);
+		for(size_t k = 0; k < boxes.size() && (int)boxes.size() < this->max_boxes; k++) {
+			int x = boxes[k] % w;
+			int y = boxes[k] / w;
+			for(int dy = -1; dy <= 1; dy++) {
+				for(int dx = -1; dx <= 1; dx++) {
+					if(this->is_wall(x + dx, y + dy)
+					   || (int)boxes.size() >= this->max_boxes) {
+						continue;
+					}
+					int j = (x + dx) + w * (y + dy);
+					Board::Field f = game.board.fields[j];
+					if((f == Board::box || f == Board::box_on_goal)
+					   && std::find(boxes.begin(), boxes.end(), j) == boxes.end()) {
+						boxes.push_back(j);
+					}
+				}
+			}
+		}
+		std::sort(boxes.begin(), boxes.end());
+	}
+
+	/**
+	 * Is a box that is not on a goal stuck in a corner of walls?
+	 */
+	bool dead_corner(int i) {
+		int w = this->base.dimensions.x;
+		int x = i % w;
+		int y = i / w;
+		if(this->is_goal(i)) {
+			return false;
+		}
+		bool horizontal = this->is_wall(x - 1, y) || this->is_wall(x + 1, y);
+		bool vertical = this->is_wall(x, y - 1) || this->is_wall(x, y + 1);
+		return horizontal && vertical;
+	}
+
+	/**
+	 * Flood fill the fields reachable by the player from field start, with
+	 * boxes given by occupied. Returns the smallest reachable index.
+	 */
+	int reach(int start, std::vector<char> &occupied, std::vector<char> &reached) {
+		int w = this->base.dimensions.x;
+		int n = this->n_fields();
+		reached.assign(n, 0);
+		std::vector<int> todo(1, start);
+		reached[start] = 1;
+		int min = start;
+		while(!todo.empty()) {
+			int i = todo.back();
+			todo.pop_back();
+			for(int a = 0; a < 4; a++) {
+				int x = i % w + actions[a].x;
+				int y = i / w + actions[a].y;
+				int j = x + w * y;
+				if(this->is_wall(x, y) || occupied[j] || reached[j]) {
+					continue;
+				}
+				reached[j] = 1;
+				min = std::min(min, j);
+				todo.push_back(j);
+			}
+		}
+		return min;
+	}
+
+	/**
+	 * Bounded push search on a board holding only the given boxes, starting
+	 * with the player in the area of field player. Returns true if the boxes
+	 * provably cannot be resolved from there.
+	 */
+	bool stuck_from(std::vector<int> &boxes, int center, int player) {
+		int w = this->base.dimensions.x;
+		int n = this->n_fields();
+		std::vector<char> occupied(n, 0);
+		std::vector<char> reached;
+		std::vector<char> child_reached;
+		std::set<std::vector<int> > seen;
+		std::vector<std::vector<int> > todo;
+		std::vector<int> state(boxes);
+		for(size_t k = 0; k < boxes.size(); k++) {
+			occupied[boxes[k]] = 1;
+		}
+		state.push_back(this->reach(player, occupied, reached));
+		for(size_t k = 0; k < boxes.size(); k++) {
+			occupied[boxes[k]] = 0;
+		}
+		seen.insert(state);
+		todo.push_back(state);
+		while(!todo.empty()) {
+			if(seen.size() > this->node_limit) {
+				return false;
+			}
+			state = todo.back();
+			todo.pop_back();
+			size_t n_boxes = state.size() - 1;
+			bool solved = true;
+			for(size_t k = 0; k < n_boxes; k++) {
+				int dx = state[k] % w - center % w;
+				int dy = state[k] / w - center / w;
+				if(std::abs(dx) > this->radius || std::abs(dy) > this->radius) {
+					return false; // Box got away; treat cluster as resolved.
+				}
+				solved = solved && this->is_goal(state[k]);
+				occupied[state[k]] = 1;
+			}
+			if(solved) {
+				return false;
+			}
+			this->reach(state[n_boxes], occupied, reached);
+			for(size_t k = 0; k < n_boxes; k++) {
+				int x = state[k] % w;
+				int y = state[k] / w;
+				for(int a = 0; a < 4; a++) {
+					int fx = x - actions[a].x, fy = y - actions[a].y;
+					int tx = x + actions[a].x, ty = y + actions[a].y;
+					if(this->is_wall(fx, fy) || this->is_wall(tx, ty)
+					   || !reached[fx + w * fy] || occupied[tx + w * ty]
+					   || this->dead_corner(tx + w * ty)) {
+						continue;
+					}
+					std::vector<int> next(state.begin(), state.begin() + n_boxes);
+					next[k] = tx + w * ty;
+					occupied[state[k]] = 0;
+					occupied[next[k]] = 1;
+					next.push_back(this->reach(state[k], occupied, child_reached));
+					occupied[next[k]] = 0;
+					occupied[state[k]] = 1;
+					std::sort(next.begin(), next.end() - 1);
+					if(seen.insert(next).second) {
+						todo.push_back(next);
+					}
+				}
+			}
+			for(size_t k = 0; k < n_boxes; k++) {
+				occupied[state[k]] = 0;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Confirm that the cluster is a deadlock, for every area the player
+	 * could be in.
+	 */
+	bool confirm(std::vector<int> &boxes, int center) {
+		this->n_searches++;
+		int n = this->n_fields();
+		std::vector<char> occupied(n, 0);
+		std::vector<char> covered(n, 0);
+		std::vector<char> reached;
+		for(size_t k = 0; k < boxes.size(); k++) {
+			occupied[boxes[k]] = 1;
+		}
+		for(int i = 0; i < n; i++) {
+			if(covered[i] || occupied[i] || this->base.fields[i] == Board::wall) {
+				continue;
+			}
+			if(!this->stuck_from(boxes, center, i)) {
+				return false;
+			}
+			this->reach(i, occupied, reached);
+			for(int j = 0; j < n; j++) {
+				covered[j] |= reached[j];
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Check whether the box just pushed onto field box takes part in a
+	 * deadlock, learning a new pattern if necessary.
+	 */
+	bool is_deadlock(Game &game, Coord box) {
+		int field = this->base.get_index(box);
+		if(this->match(game, field)) {
+			this->n_hits++;
+			return true;
+		}
+		std::vector<int> boxes;
+		this->cluster(game, field, boxes);
+		bool on_goals = true;
+		for(size_t k = 0; k < boxes.size(); k++) {
+			on_goals = on_goals && this->is_goal(boxes[k]);
+		}
+		if(boxes.size() < 2 || on_goals) {
+			return false;
+		}
+		size_t key = field;
+		for(size_t k = 0; k < boxes.size(); k++) {
+			key = key * 1000003 ^ std::hash<int>()(boxes[k]);
+		}
+		if(this->cleared.count(key)) {
+			return false;
+		}
+		if(!this->confirm(boxes, field)) {
+			this->cleared.insert(key);
+			return false;
+		}
+		this->add(boxes);
+		return true;
+	}
+
+	/**
+	 * Load patterns from a file written by save(). Returns false if the file
+	 * does not exist or belongs to a different level.
+	 */
+	bool load(const char *path) {
+		FILE *fp = fopen(path, "r");
+		if(!fp) {
+			return false;
+		}
+		unsigned long sum = 0;
+		int w = 0, h = 0;
+		if(3 != fscanf(fp, "sokoban-deadlocks %d %d %lu", &w, &h, &sum)
+		   || w != this->base.dimensions.x || h != this->base.dimensions.y
+		   || sum != this->checksum()) {
+			fclose(fp);
+			return false;
+		}
+		int size;
+		while(1 == fscanf(fp, "%d", &size)) {
+			std::vector<int> pattern(size);
+			for(int k = 0; k < size; k++) {
+				if(1 != fscanf(fp, "%d", &pattern[k])
+				   || pattern[k] < 0 || pattern[k] >= this->n_fields()) {
+					fclose(fp);
+					return false;
+				}
+			}
+			this->add(pattern);
+		}
+		fclose(fp);
+		return true;
+	}
+
+	/**
+	 * Write all patterns to a file, one per line.
+	 */
+	bool save(const char *path) {
+		FILE *fp = fopen(path, "w");
+		if(!fp) {
+			return false;
+		}
+		fprintf(fp, "sokoban-deadlocks %d %d %lu\n", this->base.dimensions.x,
+		        this->base.dimensions.y, this->checksum());
+		for(size_t k = 0; k < this->patterns.size(); k++) {
+			fprintf(fp, "%lu", this->patterns[k].size());
+			for(size_t j = 0; j < this->patterns[k].size(); j++) {
+				fprintf(fp, " %d", this->patterns[k][j]);
+			}
+			fprintf(fp, "\n");
+		}
+		fclose(fp);
+		return true;
+	}
+};
+
+/**
+ * Hook called from get_neighbors for every successor in which a box was
+ * pushed onto field box.
+ */
+bool is_pattern_deadlock(Level *level, Game &game, Coord box) {
+	return level->deadlocks && level->deadlocks->is_deadlock(game, box);
+}
+
+#endif
@@ -0,0 +1,533 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <set>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "game.cpp"
+#include "search.cpp"
+#include "heuristic.cpp"
+#include "mincostheuristic.cpp"
+#include "cost.cpp"
+#include "level.cpp"
+#include "pushgame.cpp"
+#include "dispatch.cpp"
+#include "cache.cpp"
+#include "stats.cpp"
+#include "trace.cpp"
+
+#ifndef DECOMPOSE_H
+#define DECOMPOSE_H
+
+/**
+ * Orders of pushes a join tries at most before it gives up (see
+ * SubproblemJoin).
+ */
+#define DECOMPOSE_MAX_JOIN 100000
+
+/** *************************************************************************
+ * Independent Subproblems
+ * ************************************************************************** */
+
+/**
+ * Large levels often consist of rooms whose boxes never get in each other's
+ * way, but A* searches the product of their state spaces all the same.
+ * decomposed_solve() splits the boxes of a level into groups that can be
+ * solved on their own, solves the groups in parallel and joins their
+ * solutions:
+ *
+ * - Boxes frozen on goals can never be pushed again (see find_frozen_boxes)
+ *   and count as walls.
+ * - Every other box can only ever be on the live cells it could be pushed to
+ *   if the board held no other boxes, its reach. Its zone adds the cells
+ *   the player stands on for those pushes.
+ * - Two boxes are in the same group if one's reach meets the other's zone,
+ *   in particular if both can reach the same goal.
+ *
+ * A group is solved in the push graph, on the level without the boxes and
+ * goals of the other groups. That is a relaxation of the level (the pushes
+ * of the group's boxes in any solution of the level solve it), so the level
+ * is unsolvable if a group is, and with -c pushes, the joined solution has
+ * the fewest pushes. The pushes of the group solutions are then replayed on
+ * the level itself, the player walking to each; a group whose pushes cannot
+ * be replayed yet (the boxes of another group are in the way) is tried again
+ * after the others. If no group can go on, the groups interact after all,
+ * and the whole level has to be searched.
+ */
+struct DecomposeOptions {
+	bool simple_heuristic;
+	const char *cost;     // Cost model name, NULL for moves
+	bool macros;
+	bool corrals;
+	bool partial;         // A* with partial expansion
+	int jobs;             // Number of worker threads
+
+	DecomposeOptions() : simple_heuristic(false), cost(NULL), macros(false), corrals(false),
+		partial(false), jobs(std::max((int)std::thread::hardware_concurrency(), 1)) {}
+};
+
+/**
+ * One group of boxes, with the goals it fills.
+ */
+struct Subproblem {
+	std::vector<int> boxes; // Cells of the boxes
+	int n_goals;
+	Game *start;            // The level with only this group's boxes and goals
+	std::vector<std::pair<int, int> > pushes; // Board index of the box and action of each push
+	bool solved;
+	unsigned long expansions;
+};
+
+/**
+ * Mark the cells of the boxes that can never be pushed again: a box is
+ * frozen if it is blocked along both axes, with a wall or a frozen box on
+ * either side. Starting from all boxes, those that could be pushed along an
+ * axis are unfrozen until none is left.
+ */
+std::vector<bool> find_frozen_boxes(Game &game, CellIndex &cells) {
+	std::vector<bool> frozen(cells.n_cells, false);
+	for(int c = 0; c < cells.n_cells; c++) {
+		Board::Field field = game.board.fields[cells.field[c]];
+		frozen[c] = (field == Board::box || field == Board::box_on_goal);
+	}
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		for(int c = 0; c < cells.n_cells; c++) {
+			if(!frozen[c]) {
+				continue;
+			}
+			for(int a = 0; a < 4; a += 2) { // actions come in opposite pairs
+				int one = cells.neighbors[4 * c + a];
+				int other = cells.neighbors[4 * c + a + 1];
+				if(one != -1 && other != -1 && !frozen[one] && !frozen[other]) {
+					frozen[c] = false;
+					changed = true;
+					break;
+				}
+			}
+		}
+	}
+	return frozen;
+}
+
+/**
+ * Representative of the group of box b (union-find with path halving).
+ */
+int find_group(std::vector<int> &parent, int b) {
+	while(parent[b] != b) {
+		parent[b] = parent[parent[b]];
+		b = parent[b];
+	}
+	return b;
+}
+
+/**
+ * Split the boxes of level into subproblems (see above), whose start states
+ * are newly allocated. Returns false if there is nothing to gain: the boxes
+ * form a single group and none is frozen, or the analysis shows the level
+ * to be unsolvable (a box frozen off a goal or on a dead cell, or a group
+ * with fewer goals than boxes), which the search of the whole level finds
+ * out as well. *n_frozen is set to the number of boxes frozen on goals.
+ */
+bool decompose_level(Game &level, std::vector<Subproblem> &parts, int *n_frozen) {
+	TRACE_SPAN("decompose level");
+	Board &board = level.board;
+	CellIndex cells(board);
+	int n = cells.n_cells;
+	std::vector<bool> frozen = find_frozen_boxes(level, cells);
+	std::vector<int> box_of(n, -1);
+	std::vector<int> boxes;
+	*n_frozen = 0;
+	for(int c = 0; c < n; c++) {
+		Board::Field field = board.fields[cells.field[c]];
+		if(frozen[c] && field != Board::box_on_goal) {
+			return false;
+		} else if(frozen[c]) {
+			(*n_frozen)++;
+		} else if(field == Board::box || field == Board::box_on_goal) {
+			box_of[c] = boxes.size();
+			boxes.push_back(c);
+		}
+	}
+
+	// Live cells: pull boxes away from the goals that are not frozen over.
+	std::vector<bool> open(n);
+	std::vector<bool> live(n, false);
+	std::vector<int> todo;
+	for(int c = 0; c < n; c++) {
+		Board::Field field = board.fields[cells.field[c]];
+		open[c] = !frozen[c];
+		if(open[c] && (field == Board::goal || field == Board::box_on_goal)) {
+			live[c] = true;
+			todo.push_back(c);
+		}
+	}
+	while(!todo.empty()) {
+		int to = todo.back();
+		todo.pop_back();
+		for(int a = 0; a < 4; a++) {
+			int from = cells.neighbors[4 * to + (a ^ 1)];
+			int stand = (from == -1 ? -1 : cells.neighbors[4 * from + (a ^ 1)]);
+			if(stand != -1 && open[from] && open[stand] && !live[from]) {
+				live[from] = true;
+				todo.push_back(from);
+			}
+		}
+	}
+
+	// Reach and zone of every box, as the boxes having each cell in theirs.
+	int n_boxes = boxes.size();
+	std::vector<std::vector<int> > in_reach(n);
+	std::vector<std::vector<int> > in_zone(n);
+	std::vector<int> reach_mark(n, -1);
+	std::vector<int> zone_mark(n, -1);
+	for(int b = 0; b < n_boxes; b++) {
+		if(!live[boxes[b]]) {
+			return false;
+		}
+		todo.assign(1, boxes[b]);
+		reach_mark[boxes[b]] = zone_mark[boxes[b]] = b;
+		in_reach[boxes[b]].push_back(b);
+		in_zone[boxes[b]].push_back(b);
+		while(!todo.empty()) {
+			int c = todo.back();
+			todo.pop_back();
+			for(int a = 0; a < 4; a++) {
+				int to = cells.neighbors[4 * c + a];
+				int stand = cells.neighbors[4 * c + (a ^ 1)];
+				if(to == -1 || stand == -1 || !open[stand] || !live[to]) {
+					continue;
+				}
+				if(zone_mark[stand] != b) {
+					zone_mark[stand] = b;
+					in_zone[stand].push_back(b);
+				}
+				if(reach_mark[to] != b) {
+					reach_mark[to] = b;
+					in_reach[to].push_back(b);
+					if(zone_mark[to] != b) {
+						zone_mark[to] = b;
+						in_zone[to].push_back(b);
+					}
+					todo.push_back(to);
+				}
+			}
+		}
+	}
+
+	// Group boxes whose reach meets another's zone (which contains the
+	// reach, so this also groups the boxes that can reach the same goal).
+	std::vector<int> parent(n_boxes);
+	for(int b = 0; b < n_boxes; b++) {
+		parent[b] = b;
+	}
+	for(int c = 0; c < n; c++) {
+		if(in_reach[c].empty()) {
+			continue;
+		}
+		int group = find_group(parent, in_reach[c][0]);
+		for(size_t k = 0; k < in_zone[c].size(); k++) {
+			parent[find_group(parent, in_zone[c][k])] = group;
+		}
+	}
+	std::vector<int> part_of(n_boxes, -1);
+	for(int b = 0; b < n_boxes; b++) {
+		int group = find_group(parent, b);
+		if(part_of[group] == -1) {
+			part_of[group] = parts.size();
+			parts.push_back(Subproblem());
+			parts.back().n_goals = 0;
+			parts.back().start = NULL;
+			parts.back().solved = false;
+			parts.back().expansions = 0;
+		}
+		part_of[b] = part_of[group];
+		parts[part_of[b]].boxes.push_back(boxes[b]);
+	}
+	std::vector<int> goal_part(n, -1);
+	for(int c = 0; c < n; c++) {
+		Board::Field field = board.fields[cells.field[c]];
+		if(!open[c] || (field != Board::goal && field != Board::box_on_goal)) {
+			continue;
+		}
+		if(in_reach[c].empty()) {
+			parts.clear();
+			return false;
+		}
+		goal_part[c] = part_of[in_reach[c][0]];
+		parts[goal_part[c]].n_goals++;
+	}
+	for(size_t p = 0; p < parts.size(); p++) {
+		if(parts[p].n_goals < (int)parts[p].boxes.size()) {
+			parts.clear();
+			return false;
+		}
+	}
+	if(parts.size() < 2 && *n_frozen == 0) {
+		parts.clear();
+		return false;
+	}
+
+	for(size_t p = 0; p < parts.size(); p++) {
+		Game *start = new Game(level);
+		start->level = NULL;
+		for(int c = 0; c < n; c++) {
+			bool own_box = (box_of[c] != -1 && part_of[box_of[c]] == (int)p);
+			bool own_goal = (goal_part[c] == (int)p);
+			if(frozen[c]) {
+				start->board.fields[cells.field[c]] = Board::wall;
+			} else if(own_box) {
+				start->board.fields[cells.field[c]] = (own_goal ? Board::box_on_goal : Board::box);
+			} else {
+				start->board.fields[cells.field[c]] = (own_goal ? Board::goal : Board::empty);
+			}
+		}
+		parts[p].start = start;
+	}
+	return true;
+}
+
+/**
+ * Solve part in the push graph and keep the pushes of its solution.
+ * Everything the search needs is created here, so that subproblems can be
+ * solved on several threads at once. *unsolvable is set if part turns out to
+ * be unsolvable, which cancels the searches of the other subproblems.
+ */
+void solve_subproblem(Subproblem &part, DecomposeOptions &options, std::atomic<bool> *unsolvable) {
+	TRACE_SPAN("solve subproblem");
+	Game &start = *part.start;
+	if(start.is_goal()) {
+		part.solved = true;
+		return;
+	} else if(*unsolvable) {
+		return;
+	}
+	CostModel *cost = (options.cost ? cost_model_from_name(options.cost) : NULL);
+	if(!cost || !cost->push_graph()) {
+		delete cost;
+		cost = new PushCost();
+	}
+	Heuristic *heuristic;
+	if(options.simple_heuristic) {
+		heuristic = new SimpleHeuristic();
+	} else {
+		heuristic = new MinCostHeuristic();
+	}
+	if(options.macros || options.corrals) {
+		start.level = analyze_level(start);
+		start.level->macros = options.macros;
+		start.level->corrals = options.corrals;
+	}
+	SearchLimits limits;
+	limits.cancel = unsolvable;
+	PushGame push_start(start);
+	std::vector<State *> pushes = A_star(push_start, *heuristic, false, cost, NULL, &limits,
+	                                     options.partial);
+	std::vector<State *> solution = expand_push_solution(start, pushes);
+	for(size_t i = 1; i < solution.size(); i++) {
+		Game *prev = static_cast<Game *>(solution[i-1]);
+		Game *current = static_cast<Game *>(solution[i]);
+		if(!current->edge_pushes(*prev)) {
+			continue;
+		}
+		Coord action = current->player - prev->player;
+		int a = 0;
+		while(!(actions[a] == action)) {
+			a++;
+		}
+		part.pushes.push_back(std::make_pair(start.board.get_index(current->player), a));
+	}
+	part.solved = !pushes.empty();
+	if(!part.solved && !limits.cancelled) {
+		*unsolvable = true;
+	}
+	part.expansions = limits.n_expanded;
+	for(size_t i = 0; i < pushes.size(); i++) {
+		if(pushes[i] != &push_start) {
+			delete_state(pushes[i]);
+		}
+	}
+	for(size_t i = 0; i < solution.size(); i++) {
+		delete_state(solution[i]);
+	}
+	delete[] push_start.board.fields;
+	delete start.level;
+	start.level = NULL;
+	delete heuristic;
+	delete cost;
+}
+
+/**
+ * Walk the player to push (board index of the box and action) and push, on
+ * game, appending the moves to moves. Returns false, leaving game and moves
+ * as they were, if the walk or the push is blocked.
+ */
+bool replay_push(Game &game, std::pair<int, int> &push, std::string &moves) {
+	Coord box(push.first % game.board.dimensions.x, push.first / game.board.dimensions.x);
+	Coord action = actions[push.second];
+	Board::Field field = game.board.get_field(box);
+	Board::Field target = game.board.get_field(box + action);
+	std::string walk;
+	if((field != Board::box && field != Board::box_on_goal)
+	   || (target != Board::empty && target != Board::goal)
+	   || !player_path(game, box - action, walk)) {
+		return false;
+	}
+	walk += action_char(action);
+	for(size_t i = 0; i < walk.size(); i++) {
+		game.take_action(char_action(walk[i]));
+	}
+	moves += walk;
+	return true;
+}
+
+/**
+ * Joins the solutions of the subproblems into one of the level. Pushing the
+ * boxes of one subproblem can cut the player off from the boxes of another,
+ * so which subproblem pushes next is decided by a depth-first search,
+ * trying the subproblems in order. A situation (pushes done of each
+ * subproblem, and the player's field) is tried only once, and at most
+ * DECOMPOSE_MAX_JOIN of them overall.
+ */
+struct SubproblemJoin {
+	std::vector<Subproblem> &parts;
+	Game game;
+	std::vector<size_t> done; // Pushes replayed of each subproblem
+	std::string moves;
+	std::set<std::vector<size_t> > tried;
+
+	SubproblemJoin(Game &level, std::vector<Subproblem> &parts) :
+		parts(parts), game(level), done(parts.size(), 0) {}
+
+	~SubproblemJoin() {
+		delete[] this->game.board.fields;
+	}
+
+	bool join() {
+		size_t p = 0;
+		while(p < this->parts.size() && this->done[p] == this->parts[p].pushes.size()) {
+			p++;
+		}
+		if(p == this->parts.size()) {
+			return true;
+		}
+		std::vector<size_t> situation(this->done);
+		situation.push_back(this->game.board.get_index(this->game.player));
+		if(this->tried.size() >= DECOMPOSE_MAX_JOIN || !this->tried.insert(situation).second) {
+			return false;
+		}
+		for(p = 0; p < this->parts.size(); p++) {
+			if(this->done[p] == this->parts[p].pushes.size()) {
+				continue;
+			}
+			std::pair<int, int> &push = this->parts[p].pushes[this->done[p]];
+			Coord player = this->game.player;
+			size_t length = this->moves.size();
+			if(!replay_push(this->game, push, this->moves)) {
+				continue;
+			}
+			this->done[p]++;
+			if(this->join()) {
+				return true;
+			}
+			this->done[p]--;
+			Coord box(push.first % this->game.board.dimensions.x,
+			          push.first / this->game.board.dimensions.x);
+			ranked_move_box(this->game, box + actions[push.second], box);
+			this->game.player = player;
+			this->moves.resize(length);
+		}
+		return false;
+	}
+};
+
+/**
+ * Solve level by splitting it into independent subproblems, on up to
+ * options.jobs threads. Returns false if the level does not split, or the
+ * subproblems turn out to interact, and must be searched as a whole.
+ * Otherwise the solution is stored in *solution (empty if the level is
+ * unsolvable), the expansions of all subproblems are added to limits, and
+ * the statistics of their searches to those of this thread.
+ */
+bool decomposed_solve(Game &level, DecomposeOptions &options, SearchLimits *limits,
+                      bool verbose, std::vector<State *> *solution) {
+	std::vector<Subproblem> parts;
+	int n_frozen;
+	if(!decompose_level(level, parts, &n_frozen)) {
+		if(verbose) {
+			fprintf(stderr, "The level does not decompose; searching it as a whole.\n");
+		}
+		return false;
+	}
+	if(verbose) {
+		size_t largest = 0;
+		for(size_t p = 0; p < parts.size(); p++) {
+			largest = std::max(largest, parts[p].boxes.size());
+		}
+		fprintf(stderr, "Decomposed into %lu subproblems of up to %lu boxes (%d boxes frozen on goals).\n",
+		        (unsigned long)parts.size(), (unsigned long)largest, n_frozen);
+	}
+
+	std::atomic<size_t> next(0);
+	std::atomic<bool> unsolvable(false);
+	std::mutex done;
+	SearchStats total = SearchStats();
+	bool timing = search_stats.timing;
+	std::vector<std::thread> workers;
+	for(int j = 0; j < options.jobs && j < (int)parts.size(); j++) {
+		workers.push_back(std::thread([&]() {
+			search_stats.reset(timing);
+			for(size_t i = next++; i < parts.size(); i = next++) {
+				solve_subproblem(parts[i], options, &unsolvable);
+			}
+			std::lock_guard<std::mutex> lock(done);
+			total.add(search_stats);
+		}));
+	}
+	for(size_t j = 0; j < workers.size(); j++) {
+		workers[j].join();
+	}
+	search_stats.add(total);
+
+	bool solvable = true;
+	for(size_t p = 0; p < parts.size(); p++) {
+		if(limits) {
+			limits->n_expanded += parts[p].expansions;
+		}
+		solvable = solvable && parts[p].solved;
+		if(verbose && !parts[p].pushes.empty()) {
+			fprintf(stderr, "Subproblem %lu: %lu boxes, %lu pushes, %lu expansions.\n",
+			        (unsigned long)p + 1, (unsigned long)parts[p].boxes.size(),
+			        (unsigned long)parts[p].pushes.size(), parts[p].expansions);
+		}
+	}
+
+	bool joined = false;
+	std::string moves;
+	if(solvable) {
+		TRACE_SPAN("join subproblems");
+		SubproblemJoin join(level, parts);
+		joined = join.join();
+		moves = join.moves;
+	}
+	for(size_t p = 0; p < parts.size(); p++) {
+		delete_state(parts[p].start);
+	}
+	if(!solvable) {
+		solution->clear();
+		return true;
+	}
+	if(!joined) {
+		if(verbose) {
+			fprintf(stderr, "The subproblems interact; searching the level as a whole.\n");
+		}
+		return false;
+	}
+	*solution = moves_to_solution(level, moves);
+	return true;
+}
+
+#endif
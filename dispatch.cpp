@@ -0,0 +1,95 @@
+#include <vector>
+#include "game.cpp"
+#include "search.cpp"
+#include "heuristic.cpp"
+#include "mincostheuristic.cpp"
+#include "pushgame.cpp"
+#include "pack.cpp"
+#include "rankedsearch.cpp"
+#include "cost.cpp"
+#include "checkpoint.cpp"
+#include "trace.cpp"
+
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+/** *************************************************************************
+ * A* Instances
+ * ************************************************************************** */
+
+/**
+ * The A* template (search.cpp) is instantiated for every combination of
+ * state type, heuristic and board size class; which one a search runs is
+ * decided once, here, when it starts. A heuristic other than the known ones
+ * is called virtually and uses the generic set of visited states. Levels
+ * whose whole state space can be ranked into a table of RANKED_MAX_BYTES are
+ * searched with ranked_A_star instead (rankedsearch.cpp).
+ */
+
+template<typename StateT, typename HeuristicT>
+std::vector<State *> A_star_sized(StateT &start, HeuristicT &heuristic, bool verbose,
+                                  CostModel *cost, Checkpoint *checkpoint, SearchLimits *limits,
+                                  bool partial) {
+	std::vector<State *> solution;
+	if(!partial && !checkpoint
+	   && ranked_A_star(start, heuristic, verbose, cost, limits, &solution)) {
+		return solution;
+	}
+	Board &board = start.board;
+	switch(size_class_words(CellIndex(board).n_cells)) {
+	case 1: {
+		PackedStateSet<1> visited(board);
+		return A_star<StateT, HeuristicT, AStarOpenList>(start, heuristic, visited, verbose, cost,
+		                                                 checkpoint, limits, partial);
+	}
+	case 2: {
+		PackedStateSet<2> visited(board);
+		return A_star<StateT, HeuristicT, AStarOpenList>(start, heuristic, visited, verbose, cost,
+		                                                 checkpoint, limits, partial);
+	}
+	case 4: {
+		PackedStateSet<4> visited(board);
+		return A_star<StateT, HeuristicT, AStarOpenList>(start, heuristic, visited, verbose, cost,
+		                                                 checkpoint, limits, partial);
+	}
+	case SIZE_CLASS_MAX_CELLS / 64: {
+		PackedStateSet<SIZE_CLASS_MAX_CELLS / 64> visited(board);
+		return A_star<StateT, HeuristicT, AStarOpenList>(start, heuristic, visited, verbose, cost,
+		                                                 checkpoint, limits, partial);
+	}
+	}
+	PointerSet<Game> visited;
+	return A_star<StateT, HeuristicT, AStarOpenList>(start, heuristic, visited, verbose, cost,
+	                                                 checkpoint, limits, partial);
+}
+
+template<typename StateT>
+std::vector<State *> A_star_typed(StateT &start, Heuristic &heuristic, bool verbose,
+                                  CostModel *cost, Checkpoint *checkpoint, SearchLimits *limits,
+                                  bool partial) {
+	if(MinCostHeuristic *mincost = dynamic_cast<MinCostHeuristic *>(&heuristic)) {
+		return A_star_sized(start, *mincost, verbose, cost, checkpoint, limits, partial);
+	} else if(SimpleHeuristic *simple = dynamic_cast<SimpleHeuristic *>(&heuristic)) {
+		return A_star_sized(start, *simple, verbose, cost, checkpoint, limits, partial);
+	}
+	PointerSet<Game> visited;
+	return A_star<StateT, Heuristic, AStarOpenList>(start, heuristic, visited, verbose, cost,
+	                                                checkpoint, limits, partial);
+}
+
+/**
+ * A* search from start, a Game or a PushGame, with partial expansion if
+ * partial is set; see the template in search.cpp.
+ */
+std::vector<State *> A_star(State &start, Heuristic &heuristic, bool verbose = true,
+                            CostModel *cost = NULL, Checkpoint *checkpoint = NULL,
+                            SearchLimits *limits = NULL, bool partial = false) {
+	TRACE_SPAN("A* search");
+	if(PushGame *push = dynamic_cast<PushGame *>(&start)) {
+		return A_star_typed(*push, heuristic, verbose, cost, checkpoint, limits, partial);
+	}
+	return A_star_typed(static_cast<Game &>(start), heuristic, verbose, cost, checkpoint, limits,
+	                    partial);
+}
+
+#endif
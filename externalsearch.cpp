@@ -0,0 +1,504 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <algorithm>
+#include "game.cpp"
+#include "search.cpp"
+#include "pack.cpp"
+#include "trace.cpp"
+
+#ifndef EXTERNALSEARCH_H
+#define EXTERNALSEARCH_H
+
+/** *************************************************************************
+ * External-Memory A* Search
+ * ************************************************************************** */
+
+/**
+ * Size of the stdio buffers used when streaming records from/to disk.
+ */
+#define EXTERNAL_READ_BUFFER  (1 << 20)
+#define EXTERNAL_WRITE_BUFFER (1 << 18)
+
+/**
+ * Move byte stored with every record: the direction (index into the actions
+ * of Game::expand) that led to this state, with bit 2 set if that move
+ * pushed a box. The start state has no move.
+ */
+#define EXTERNAL_NO_MOVE 0xff
+#define EXTERNAL_PUSHED  0x04
+
+/**
+ * A file of fixed-size records accessed through a large stdio buffer, so that
+ * all disk accesses are sequential and in big chunks.
+ */
+struct RecordStream {
+	FILE *fp;
+	char *buffer;
+	size_t record_size;
+
+	RecordStream() : fp(NULL), buffer(NULL), record_size(0) {}
+
+	bool open(const std::string &path, const char *mode, size_t record_size,
+	          size_t buffer_size) {
+		this->record_size = record_size;
+		this->fp = fopen(path.c_str(), mode);
+		if(!this->fp) {
+			return false;
+		}
+		if(mode[0] == 'r') {
+			// No point in buffering more than the whole file.
+			fseek(this->fp, 0, SEEK_END);
+			buffer_size = std::min(buffer_size, (size_t)ftell(this->fp) + 1);
+			rewind(this->fp);
+		}
+		this->buffer = new char[buffer_size];
+		setvbuf(this->fp, this->buffer, _IOFBF, buffer_size);
+		return true;
+	}
+
+	bool read(unsigned char *record) {
+		return 1 == fread(record, this->record_size, 1, this->fp);
+	}
+
+	void write(const unsigned char *record) {
+		size_t written = fwrite(record, this->record_size, 1, this->fp);
+		assert(written == 1);
+	}
+
+	void close() {
+		if(this->fp) {
+			fclose(this->fp);
+		}
+		delete[] this->buffer;
+		this->fp = NULL;
+		this->buffer = NULL;
+	}
+};
+
+/**
+ * Reader over a sorted run that always holds the next record in memory; used
+ * for k-way merging and for streaming duplicate elimination.
+ */
+struct RunReader {
+	RecordStream stream;
+	std::vector<unsigned char> current;
+	bool valid;
+
+	RunReader(const std::string &path, size_t record_size) {
+		bool opened = this->stream.open(path, "rb", record_size,
+		                                EXTERNAL_READ_BUFFER);
+		assert(opened);
+		this->current.resize(record_size);
+		this->advance();
+	}
+
+	~RunReader() {
+		this->stream.close();
+	}
+
+	void advance() {
+		this->valid = this->stream.read(&this->current[0]);
+	}
+};
+
+/**
+ * External-memory A* in the style of Edelkamp et al.: the frontier is kept
+ * in one bucket file per (g, h) pair and buckets are expanded in order of
+ * increasing f = g + h, ties broken by smaller g. Nothing but the bucket
+ * bookkeeping lives in memory.
+ *
+ * Before a bucket is expanded, its file is sorted externally (sorted runs of
+ * at most sort_memory bytes, then a streaming k-way merge). Duplicates are
+ * removed during the merge, and states already expanded are subtracted by
+ * merging against the closed runs of all earlier buckets with the same h
+ * value (a state always has the same h, so any earlier copy must be there).
+ * The surviving states are written as a new sorted closed run, which doubles
+ * as the record of the search for solution reconstruction.
+ *
+ * The heuristic must return integral values.
+ */
+struct ExternalSearch {
+	typedef std::pair<int, int> Bucket; // (g, h)
+
+	StatePacker packer;
+	Heuristic &heuristic;
+	std::string dir;
+	size_t sort_memory;
+	size_t key_size;
+	size_t record_size;
+	bool verbose;
+	unsigned long n_files;
+	std::map<Bucket, RecordStream *> open;          // Unsorted frontier buckets
+	std::map<Bucket, std::vector<std::string> > closed; // Sorted expanded runs
+	std::map<int, std::vector<std::string> > layers; // Closed runs by g
+
+	ExternalSearch(Game &start, Heuristic &heuristic, const char *tmp_dir,
+	               size_t sort_memory, bool verbose) :
+		packer(start),
+		heuristic(heuristic),
+		sort_memory(sort_memory),
+		verbose(verbose),
+		n_files(0) {
+		this->key_size = this->packer.size;
+		this->record_size = this->key_size + 1;
+		std::string tmpl = std::string(tmp_dir) + "/sokoban-XXXXXX";
+		std::vector<char> path(tmpl.begin(), tmpl.end());
+		path.push_back('\0');
+		char *created = mkdtemp(&path[0]);
+		assert(created != NULL);
+		this->dir = created;
+	}
+
+	~ExternalSearch() {
+		for(std::map<Bucket, RecordStream *>::iterator it = this->open.begin(); it != this->open.end(); ++it) {
+			it->second->close();
+			delete it->second;
+		}
+		for(std::map<int, std::vector<std::string> >::iterator it = this->layers.begin(); it != this->layers.end(); ++it) {
+			for(size_t i = 0; i < it->second.size(); i++) {
+				unlink(it->second[i].c_str());
+			}
+		}
+		for(std::map<Bucket, RecordStream *>::iterator it = this->open.begin(); it != this->open.end(); ++it) {
+			unlink(this->open_path(it->first).c_str());
+		}
+		rmdir(this->dir.c_str());
+	}
+
+	std::string new_path(const char *kind) {
+		char name[64];
+		snprintf(name, sizeof(name), "/%s-%lu.bin", kind, this->n_files++);
+		return this->dir + name;
+	}
+
+	std::string open_path(Bucket bucket) {
+		char name[64];
+		snprintf(name, sizeof(name), "/open-%d-%d.bin", bucket.first, bucket.second);
+		return this->dir + name;
+	}
+
+	int compare(const unsigned char *a, const unsigned char *b) {
+		return memcmp(a, b, this->key_size);
+	}
+
+	/**
+	 * Append a record to the frontier bucket (g, h).
+	 */
+	void push(int g, int h, const unsigned char *record) {
+		Bucket bucket(g, h);
+		if(!this->open.count(bucket)) {
+			RecordStream *stream = new RecordStream();
+			bool opened = stream->open(this->open_path(bucket), "ab",
+			                           this->record_size,
+			                           EXTERNAL_WRITE_BUFFER);
+			assert(opened);
+			this->open[bucket] = stream;
+		}
+		this->open[bucket]->write(record);
+	}
+
+	/**
+	 * Split an unsorted bucket file into sorted runs that each fit in
+	 * sort_memory bytes. Returns paths of the runs.
+	 */
+	std::vector<std::string> make_runs(const std::string &path) {
+		std::vector<std::string> runs;
+		RecordStream in;
+		bool opened = in.open(path, "rb", this->record_size, EXTERNAL_READ_BUFFER);
+		assert(opened);
+		fseek(in.fp, 0, SEEK_END);
+		size_t n_records = ftell(in.fp) / this->record_size;
+		rewind(in.fp);
+		size_t per_run = std::max((size_t)1, this->sort_memory / this->record_size);
+		per_run = std::min(per_run, std::max((size_t)1, n_records));
+		std::vector<unsigned char> chunk(per_run * this->record_size);
+		std::vector<unsigned char *> order;
+		while(true) {
+			size_t n = fread(&chunk[0], this->record_size, per_run, in.fp);
+			if(n == 0) {
+				break;
+			}
+			order.resize(n);
+			for(size_t i = 0; i < n; i++) {
+				order[i] = &chunk[i * this->record_size];
+			}
+			size_t key_size = this->key_size;
+			std::sort(order.begin(), order.end(),
+			          [key_size](const unsigned char *a, const unsigned char *b) {
+				return memcmp(a, b, key_size) < 0;
+			});
+			std::string run = this->new_path("run");
+			RecordStream out;
+			opened = out.open(run, "wb", this->record_size, EXTERNAL_WRITE_BUFFER);
+			assert(opened);
+			for(size_t i = 0; i < n; i++) {
+				out.write(order[i]);
+			}
+			out.close();
+			runs.push_back(run);
+		}
+		in.close();
+		return runs;
+	}
+
+	/**
+	 * Merge the sorted runs of bucket (g, h), dropping duplicates within the
+	 * bucket as well as states present in a closed run of an earlier bucket
+	 * with the same h. Writes the survivors as a new closed run and returns
+	 * its path, or an empty string if nothing survived.
+	 */
+	std::string merge_bucket(Bucket bucket, std::vector<std::string> &runs) {
+		typedef std::pair<RunReader *, size_t> Head;
+		std::vector<RunReader *> readers;
+		for(size_t i = 0; i < runs.size(); i++) {
+			readers.push_back(new RunReader(runs[i], this->record_size));
+		}
+		std::vector<RunReader *> seen;
+		for(std::map<Bucket, std::vector<std::string> >::iterator it = this->closed.begin(); it != this->closed.end(); ++it) {
+			if(it->first.second != bucket.second || it->first.first > bucket.first) {
+				continue;
+			}
+			for(size_t i = 0; i < it->second.size(); i++) {
+				seen.push_back(new RunReader(it->second[i], this->record_size));
+			}
+		}
+		ExternalSearch *self = this;
+		auto greater = [self](const Head &a, const Head &b) {
+			return self->compare(&a.first->current[0], &b.first->current[0]) > 0;
+		};
+		std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(greater);
+		for(size_t i = 0; i < readers.size(); i++) {
+			if(readers[i]->valid) {
+				heads.push(Head(readers[i], i));
+			}
+		}
+
+		std::string path = this->new_path("closed");
+		RecordStream out;
+		bool opened = out.open(path, "wb", this->record_size, EXTERNAL_WRITE_BUFFER);
+		assert(opened);
+		std::vector<unsigned char> last(this->record_size);
+		bool have_last = false;
+		unsigned long n_written = 0;
+		while(!heads.empty()) {
+			Head head = heads.top();
+			heads.pop();
+			const unsigned char *record = &head.first->current[0];
+			bool duplicate = have_last && this->compare(record, &last[0]) == 0;
+			if(!duplicate) {
+				memcpy(&last[0], record, this->record_size);
+				have_last = true;
+				for(size_t i = 0; i < seen.size() && !duplicate; i++) {
+					while(seen[i]->valid && this->compare(&seen[i]->current[0], record) < 0) {
+						seen[i]->advance();
+					}
+					duplicate = seen[i]->valid && this->compare(&seen[i]->current[0], record) == 0;
+				}
+				if(!duplicate) {
+					out.write(record);
+					n_written++;
+				}
+			}
+			head.first->advance();
+			if(head.first->valid) {
+				heads.push(head);
+			}
+		}
+		out.close();
+		for(size_t i = 0; i < readers.size(); i++) {
+			delete readers[i];
+			unlink(runs[i].c_str());
+		}
+		for(size_t i = 0; i < seen.size(); i++) {
+			delete seen[i];
+		}
+		if(!n_written) {
+			unlink(path.c_str());
+			return std::string();
+		}
+		return path;
+	}
+
+	/**
+	 * Find the record with the given key in any closed run of layer g using
+	 * binary search on the (sorted, fixed-size record) run files.
+	 */
+	bool find_in_layer(int g, const unsigned char *key, unsigned char *record) {
+		std::vector<std::string> &runs = this->layers[g];
+		for(size_t i = 0; i < runs.size(); i++) {
+			FILE *fp = fopen(runs[i].c_str(), "rb");
+			assert(fp != NULL);
+			fseek(fp, 0, SEEK_END);
+			long lo = 0;
+			long hi = ftell(fp) / this->record_size;
+			while(lo < hi) {
+				long mid = lo + (hi - lo) / 2;
+				fseek(fp, mid * this->record_size, SEEK_SET);
+				size_t n = fread(record, this->record_size, 1, fp);
+				assert(n == 1);
+				int cmp = this->compare(record, key);
+				if(cmp == 0) {
+					fclose(fp);
+					return true;
+				} else if(cmp < 0) {
+					lo = mid + 1;
+				} else {
+					hi = mid;
+				}
+			}
+			fclose(fp);
+		}
+		return false;
+	}
+
+	/**
+	 * Walk back from the goal record at depth g by undoing the stored moves,
+	 * looking up each predecessor in the closed runs of the previous layer.
+	 */
+	std::vector<State *> reconstruct(int g, const unsigned char *goal_record) {
+		std::vector<State *> out;
+		std::vector<unsigned char> record(goal_record, goal_record + this->record_size);
+		while(true) {
+			Game *state = new Game();
+			*state = this->packer.unpack(&record[0]);
+			out.push_back(state);
+			unsigned char move = record[this->key_size];
+			if(move == EXTERNAL_NO_MOVE) {
+				break;
+			}
+			Coord action = actions[move & 0x03];
+			Game parent(*state);
+			if(move & EXTERNAL_PUSHED) {
+				Coord box = parent.player + action;
+				Board::Field field = parent.board.get_field(box);
+				parent.board.set_field(box, field == Board::box_on_goal ? Board::goal : Board::empty);
+				field = parent.board.get_field(parent.player);
+				parent.board.set_field(parent.player, field == Board::goal ? Board::box_on_goal : Board::box);
+			}
+			parent.player = parent.player - action;
+			std::vector<unsigned char> key(this->record_size);
+			this->packer.pack(parent, &key[0]);
+			delete[] parent.board.fields;
+			g--;
+			bool found = this->find_in_layer(g, &key[0], &record[0]);
+			assert(found);
+		}
+		std::reverse(out.begin(), out.end());
+		return out;
+	}
+
+	/**
+	 * Expand all states in the closed run of bucket (g, h), writing their
+	 * successors to the frontier buckets of layer g+1. Returns true and fills
+	 * goal_record if a goal state is found in the run.
+	 */
+	bool expand_run(Bucket bucket, const std::string &path,
+	                unsigned char *goal_record) {
+		RunReader run(path, this->record_size);
+		std::vector<unsigned char> child(this->record_size);
+		for(; run.valid; run.advance()) {
+			Game current = this->packer.unpack(&run.current[0]);
+			if(current.is_goal()) {
+				memcpy(goal_record, &run.current[0], this->record_size);
+				delete[] current.board.fields;
+				return true;
+			}
+			std::vector<State *> neighbors = current.get_neighbors();
+			for(std::vector<State *>::iterator it = neighbors.begin(); it != neighbors.end(); ++it) {
+				Game *neighbor = static_cast<Game *>(*it);
+				double h = evaluate(this->heuristic, *neighbor);
+				if(h != INFINITY) {
+					Coord offs = neighbor->player - current.player;
+					unsigned char move = 0;
+					while(!(actions[move] == offs)) {
+						move++;
+					}
+					Board::Field field = current.board.get_field(neighbor->player);
+					if(field == Board::box || field == Board::box_on_goal) {
+						move |= EXTERNAL_PUSHED;
+					}
+					this->packer.pack(*neighbor, &child[0]);
+					child[this->key_size] = move;
+					this->push(bucket.first + 1, (int)lround(h), &child[0]);
+				}
+				delete[] neighbor->board.fields;
+				delete neighbor;
+			}
+			delete[] current.board.fields;
+		}
+		return false;
+	}
+
+	std::vector<State *> run(Game &start) {
+		double h0 = evaluate(this->heuristic, start);
+		if(h0 == INFINITY) {
+			return std::vector<State *>();
+		}
+		std::vector<unsigned char> record(this->record_size);
+		this->packer.pack(start, &record[0]);
+		record[this->key_size] = EXTERNAL_NO_MOVE;
+		this->push(0, (int)lround(h0), &record[0]);
+
+		while(!this->open.empty()) {
+			// Pick bucket with smallest f, ties broken by smallest g.
+			std::map<Bucket, RecordStream *>::iterator next = this->open.begin();
+			for(std::map<Bucket, RecordStream *>::iterator it = this->open.begin(); it != this->open.end(); ++it) {
+				int f = it->first.first + it->first.second;
+				int best_f = next->first.first + next->first.second;
+				if(f < best_f || (f == best_f && it->first.first < next->first.first)) {
+					next = it;
+				}
+			}
+			Bucket bucket = next->first;
+			next->second->close();
+			delete next->second;
+			this->open.erase(next);
+
+			std::string path = this->open_path(bucket);
+			std::vector<std::string> runs = this->make_runs(path);
+			unlink(path.c_str());
+			std::string closed = this->merge_bucket(bucket, runs);
+			if(closed.empty()) {
+				continue;
+			}
+			this->closed[bucket].push_back(closed);
+			this->layers[bucket.first].push_back(closed);
+			if(this->verbose) {
+				FILE *fp = fopen(closed.c_str(), "rb");
+				fseek(fp, 0, SEEK_END);
+				fprintf(stderr, "Expanding bucket g=%d h=%d f=%d: %ld states\n",
+				        bucket.first, bucket.second, bucket.first + bucket.second,
+				        ftell(fp) / (long)this->record_size);
+				fclose(fp);
+			}
+			if(this->expand_run(bucket, closed, &record[0])) {
+				return this->reconstruct(bucket.first, &record[0]);
+			}
+		}
+		return std::vector<State *>();
+	}
+};
+
+/**
+ * External-memory A* search. Works like A_star, but spills the frontier and
+ * the closed set to files in a fresh directory below tmp_dir instead of
+ * keeping them in memory. sort_memory bounds the memory used for sorting.
+ */
+std::vector<State *> external_A_star(Game &start, Heuristic &heuristic,
+                                     const char *tmp_dir,
+                                     size_t sort_memory = (size_t)256 << 20,
+                                     bool verbose = true) {
+	TRACE_SPAN("external search");
+	ExternalSearch search(start, heuristic, tmp_dir, sort_memory, verbose);
+	return search.run(start);
+}
+
+#endif
@@ -1,5 +1,8 @@
+#include <cassert>
+#include <cstring>
 #include <vector>
 #include <functional>
+#include "stats.cpp"
 
 #ifndef GAME_H
 #define GAME_H
@@ -9,8 +12,22 @@
  * ************************************************************************** */
 
 struct State {
+	virtual ~State() {}
 	virtual bool is_goal() = 0;
-	virtual std::vector<State *> get_neighbors() = 0;
+
+	/**
+	 * Append all successors of this state to neighbors. Searches pass the
+	 * same buffer for every state they expand, so that successor generation
+	 * does not allocate a vector per state.
+	 */
+	virtual void expand(std::vector<State *> &neighbors) = 0;
+
+	std::vector<State *> get_neighbors() {
+		std::vector<State *> neighbors;
+		this->expand(neighbors);
+		return neighbors;
+	}
+
 	virtual bool operator==(const State &other) const = 0;
 	virtual size_t hash() const = 0;
 };
@@ -28,13 +45,13 @@ struct Coord {
 		this->x = x;
 		this->y = y;
 	}
-	Coord operator+(const Coord &b) {
+	Coord operator+(const Coord &b) const {
 		Coord res;
 		res.x = this->x + b.x;
 		res.y = this->y + b.y;
 		return res;
 	}
-	Coord operator-(const Coord &b) {
+	Coord operator-(const Coord &b) const {
 		Coord res;
 		res.x = this->x - b.x;
 		res.y = this->y - b.y;
@@ -49,6 +66,44 @@ struct Coord {
 };
 
 
+/**
+ * The four possible actions, in the order in which successors are generated.
+ */
+const Coord actions[4] = {Coord(-1, 0),
+			  Coord(+1, 0),
+			  Coord(0, -1),
+			  Coord(0, +1)};
+
+/**
+ * Translate an action to its letter in solution output: up, down, left or
+ * right.
+ */
+char action_char(Coord action) {
+	if(action.x == -1) {
+		return 'L';
+	} else if(action.x == +1) {
+		return 'R';
+	} else if(action.y == -1) {
+		return 'U';
+	} else if(action.y == +1) {
+		return 'D';
+	}
+	return '?';
+}
+
+/**
+ * Inverse of action_char.
+ */
+Coord char_action(char c) {
+	switch(c) {
+		case 'L': return Coord(-1, 0);
+		case 'R': return Coord(+1, 0);
+		case 'U': return Coord(0, -1);
+		case 'D': return Coord(0, +1);
+	}
+	return Coord(0, 0);
+}
+
 /**
  * The board is represented as a NxM (row-major) matrix of fields, each of which
  * can be an empty field, wall, box, box on goal or player.
@@ -115,17 +170,23 @@ struct Board {
 
 };
 
+struct Game;
+struct Level;
+bool is_pattern_deadlock(Level *level, Game &game, Coord box);
+
 /**
  * The current game state is represented by the player position (X, Y) and the
- * current board state.
+ * current board state. All states of a search share the (optional) analysis
+ * of the level they belong to.
  */
 struct Game : State {
 	Coord player;
 	Board board;
+	Level *level;
 
-	Game() {}
+	Game() : level(NULL) {}
 
-	Game(Coord player, Board board) : player(player), board(board) {}
+	Game(Coord player, Board board) : player(player), board(board), level(NULL) {}
 
 	/**
 	 * Given the current board state, tell whether the desired action is legal.
@@ -245,25 +306,60 @@ struct Game : State {
 	/**
 	 * Give all legal and not obviously unsolvable actions from current state.
 	 */
-	std::vector<State *> get_neighbors() {
-		std::vector<State *> neighbors;
-		Coord actions[4] = {Coord(-1, 0),
-				    Coord(+1, 0),
-				    Coord(0, -1),
-				    Coord(0, +1)};
+	void expand(std::vector<State *> &neighbors) {
 		for(int i = 0; i < 4; i++) {
 			Coord action = actions[i];
 			if(!this->is_action_legal(action)) {
 				continue;
 			}
 			Game *neighbor = new Game(*this);
-			neighbor->take_action(action);
+			int pushed = neighbor->take_action(action);
 			if(neighbor->is_obviously_unsolvable()) {
+				search_stats.pruned_corner++;
+				delete[] neighbor->board.fields;
+				delete neighbor;
+				continue;
+			}
+			if(pushed && this->level
+			   && is_pattern_deadlock(this->level, *neighbor, neighbor->player + action)) {
+				search_stats.pruned_pattern++;
+				delete[] neighbor->board.fields;
+				delete neighbor;
 				continue;
 			}
 			neighbors.push_back(static_cast<State *>(neighbor));
 		}
-		return neighbors;
+	}
+
+	/**
+	 * Allocate a copy of this state of the same dynamic type.
+	 */
+	virtual Game *copy() {
+		return new Game(*this);
+	}
+
+	/**
+	 * Approximate number of bytes this state occupies in memory.
+	 */
+	virtual size_t footprint() {
+		return sizeof(Game) + sizeof(Board::Field) * this->board.dimensions.x
+		       * this->board.dimensions.y;
+	}
+
+	/**
+	 * Number of player moves on the transition from parent to this state.
+	 */
+	virtual int edge_moves(Game &parent) {
+		return 1;
+	}
+
+	/**
+	 * Number of box pushes on the transition from parent to this state. A
+	 * move is a push iff the player steps onto a field that held a box.
+	 */
+	virtual int edge_pushes(Game &parent) {
+		Board::Field field = parent.board.get_field(this->player);
+		return (field == Board::box || field == Board::box_on_goal ? 1 : 0);
 	}
 
 	/**
@@ -278,16 +374,27 @@ struct Game : State {
 	 * Hash this state
 	 */
 	size_t hash() const {
-		size_t hash = 0;
-		std::hash<int> int_hasher;
-		hash ^= int_hasher(this->player.x) ^ int_hasher(this->player.y);
+		// FNV-1a over player position and fields, so that the hash depends
+		// on where the boxes are and not only on how many there are.
+		unsigned long long hash = 14695981039346656037ULL;
+		hash = (hash ^ (unsigned int)this->player.x) * 1099511628211ULL;
+		hash = (hash ^ (unsigned int)this->player.y) * 1099511628211ULL;
 		int n = this->board.dimensions.x * this->board.dimensions.y;
 		for(int i = 0; i < n; i++) {
-			hash ^= int_hasher(this->board.fields[i]);
+			hash = (hash ^ this->board.fields[i]) * 1099511628211ULL;
 		}
-		return hash;
+		return (size_t)hash;
 	}
 
 };
 
+/**
+ * Free a state allocated by get_neighbors, including its board.
+ */
+void delete_state(State *state) {
+	Game *game = static_cast<Game *>(state);
+	delete[] game->board.fields;
+	delete game;
+}
+
 #endif
@@ -0,0 +1,303 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include "game.cpp"
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+/** *************************************************************************
+ * Level Generator
+ * ************************************************************************** */
+
+/**
+ * Levels are generated backwards: a room is carved out of solid wall, the
+ * boxes are put on goals, and then the player walks around at random and
+ * pulls boxes away from the goals. Every pull undoes a push, so the level is
+ * solvable by construction, and the number of pulls is a rough measure of
+ * how hard it is. The player keeps pulling until every box is off the goals,
+ * so that no box is left where it needs no push at all. Of a few such
+ * candidates the one with the boxes farthest from the goals is kept, and
+ * its board is then cut down to the carved area and the walls around it.
+ *
+ * The generator is deterministic: the same options and seed always give the
+ * same level.
+ */
+struct GeneratorOptions {
+	int width;
+	int height;
+	int boxes;
+	int difficulty;     // Number of pulls
+	unsigned long seed;
+
+	GeneratorOptions() : width(10), height(10), boxes(3), difficulty(20), seed(1) {}
+};
+
+/**
+ * Share of the inside of the board (all but the outer walls) that is carved
+ * into floor.
+ */
+#define GENERATOR_FLOOR_SHARE 0.5
+
+/**
+ * Random moves tried per pull asked for, at most, before a level is given up
+ * (and started over with fresh random numbers).
+ */
+#define GENERATOR_MOVES_PER_PULL 200
+#define GENERATOR_ATTEMPTS 100
+
+/**
+ * Number of candidate levels generated per level; the one whose boxes ended
+ * up farthest from the goals is kept.
+ */
+#define GENERATOR_CANDIDATES 8
+
+struct LevelGenerator {
+	GeneratorOptions options;
+	std::mt19937 rng;
+
+	LevelGenerator(GeneratorOptions &options) : options(options), rng(options.seed) {}
+
+	/**
+	 * A random number in [0, n). Only the raw output of the engine is used,
+	 * which (unlike the standard distributions) is the same with every
+	 * standard library, so that seeds give the same levels everywhere.
+	 */
+	int random(int n) {
+		return this->rng() % n;
+	}
+
+	/**
+	 * Carve a connected area of floor by a random walk over the inside of
+	 * the board, starting in its middle. Returns the board indices of the
+	 * floor fields.
+	 */
+	std::vector<int> carve(Board &board) {
+		int inside = (board.dimensions.x - 2) * (board.dimensions.y - 2);
+		int target = std::max((int)(inside * GENERATOR_FLOOR_SHARE), this->options.boxes * 2 + 1);
+		target = std::min(target, inside);
+		std::vector<int> floor;
+		Coord pos(board.dimensions.x / 2, board.dimensions.y / 2);
+		while((int)floor.size() < target) {
+			if(board.get_field(pos) == Board::wall) {
+				board.set_field(pos, Board::empty);
+				floor.push_back(board.get_index(pos));
+			}
+			Coord next = pos + actions[this->random(4)];
+			if(next.x >= 1 && next.y >= 1 && next.x < board.dimensions.x - 1
+			   && next.y < board.dimensions.y - 1) {
+				pos = next;
+			}
+		}
+		return floor;
+	}
+
+	/**
+	 * Undo a move of the player along action: the player steps back and
+	 * pulls the box in front of it (if any) along. Returns whether the
+	 * player could move, and stores whether a box came along in *pulled.
+	 */
+	bool move_back(Game &game, Coord action, bool *pulled) {
+		*pulled = false;
+		Coord to = game.player - action;
+		Board::Field target = game.board.get_field(to);
+		if(target != Board::empty && target != Board::goal) {
+			return false;
+		}
+		Coord box = game.player + action;
+		Board::Field field = game.board.get_field(box);
+		if(field == Board::box || field == Board::box_on_goal) {
+			game.board.set_field(box, (field == Board::box ? Board::empty : Board::goal));
+			Board::Field here = game.board.get_field(game.player);
+			game.board.set_field(game.player, (here == Board::goal ? Board::box_on_goal : Board::box));
+			*pulled = true;
+		}
+		game.player = to;
+		return true;
+	}
+
+	/**
+	 * Cut the board of game down to the smallest rectangle holding all
+	 * non-wall fields, plus one layer of wall around them.
+	 */
+	void trim(Game &game) {
+		Board &board = game.board;
+		Coord min(board.dimensions.x, board.dimensions.y), max(-1, -1);
+		for(int y = 0; y < board.dimensions.y; y++) {
+			for(int x = 0; x < board.dimensions.x; x++) {
+				if(board.get_field(Coord(x, y)) != Board::wall) {
+					min = Coord(std::min(min.x, x), std::min(min.y, y));
+					max = Coord(std::max(max.x, x), std::max(max.y, y));
+				}
+			}
+		}
+		Coord origin(min.x - 1, min.y - 1);
+		Coord dimensions(max.x - min.x + 3, max.y - min.y + 3);
+		Board::Field *fields = new Board::Field[dimensions.x * dimensions.y];
+		for(int y = 0; y < dimensions.y; y++) {
+			for(int x = 0; x < dimensions.x; x++) {
+				fields[x + dimensions.x * y] = board.get_field(origin + Coord(x, y));
+			}
+		}
+		delete[] board.fields;
+		board.fields = fields;
+		board.dimensions = dimensions;
+		game.player = game.player - origin;
+	}
+
+	/**
+	 * Sum over the boxes of the Manhattan distance to the nearest goal, a
+	 * cheap stand-in for the number of pushes the level needs.
+	 */
+	int spread(Game &game) {
+		std::vector<Coord> boxes, goals;
+		for(int y = 0; y < game.board.dimensions.y; y++) {
+			for(int x = 0; x < game.board.dimensions.x; x++) {
+				Board::Field field = game.board.get_field(Coord(x, y));
+				if(field == Board::box || field == Board::box_on_goal) {
+					boxes.push_back(Coord(x, y));
+				}
+				if(field == Board::goal || field == Board::box_on_goal) {
+					goals.push_back(Coord(x, y));
+				}
+			}
+		}
+		int sum = 0;
+		for(size_t b = 0; b < boxes.size(); b++) {
+			int nearest = INT_MAX;
+			for(size_t g = 0; g < goals.size(); g++) {
+				nearest = std::min(nearest, abs(boxes[b].x - goals[g].x) + abs(boxes[b].y - goals[g].y));
+			}
+			sum += nearest;
+		}
+		return sum;
+	}
+
+	/**
+	 * Generate one level into *game (which gets a newly allocated board).
+	 * Returns false if no level with all boxes off their goals came out,
+	 * e.g. because the board is too small for the boxes.
+	 */
+	bool generate(Game *game) {
+		GeneratorOptions &o = this->options;
+		if(o.width < 3 || o.height < 3 || o.boxes < 1
+		   || (o.width - 2) * (o.height - 2) < 2 * o.boxes + 1) {
+			return false;
+		}
+		int n = o.width * o.height;
+		game->board.dimensions = Coord(o.width, o.height);
+		game->board.fields = new Board::Field[n];
+		game->level = NULL;
+		std::vector<Board::Field> best;
+		Coord best_player;
+		int best_spread = -1, candidates = 0;
+		for(int attempt = 0; attempt < GENERATOR_ATTEMPTS && candidates < GENERATOR_CANDIDATES; attempt++) {
+			for(int i = 0; i < n; i++) {
+				game->board.fields[i] = Board::wall;
+			}
+			std::vector<int> floor = this->carve(game->board);
+			for(int i = floor.size() - 1; i > 0; i--) {
+				std::swap(floor[i], floor[this->random(i + 1)]);
+			}
+			for(int b = 0; b < o.boxes; b++) {
+				game->board.fields[floor[b]] = Board::box_on_goal;
+			}
+			game->player = Coord(floor[o.boxes] % o.width, floor[o.boxes] / o.width);
+
+			int pulls = 0;
+			int on_goals = o.boxes;
+			int a = 0;
+			bool pulled = false;
+			for(long m = 0; m < (long)GENERATOR_MOVES_PER_PULL * std::max(o.difficulty, o.boxes)
+			                   && (pulls < o.difficulty || on_goals > 0); m++) {
+				// Mostly keep pulling the same way, so that pulls carry a
+				// box away instead of shuffling it around its goal
+				if(!pulled || this->random(4) == 0) {
+					a = this->random(4);
+				}
+				if(this->move_back(*game, actions[a], &pulled) && pulled) {
+					pulls++;
+					on_goals = 0;
+					for(size_t f = 0; f < floor.size(); f++) {
+						on_goals += (game->board.fields[floor[f]] == Board::box_on_goal);
+					}
+				}
+			}
+			if(on_goals == 0) {
+				candidates++;
+				int spread = this->spread(*game);
+				if(spread > best_spread) {
+					best.assign(game->board.fields, game->board.fields + n);
+					best_player = game->player;
+					best_spread = spread;
+				}
+			}
+		}
+		if(best_spread < 0) {
+			return false;
+		}
+		std::copy(best.begin(), best.end(), game->board.fields);
+		game->player = best_player;
+		this->trim(*game);
+		return true;
+	}
+};
+
+/**
+ * Write a level in XSB notation (see collection.cpp), one line per row.
+ */
+std::string board_to_xsb(Game &game) {
+	std::string out;
+	for(int y = 0; y < game.board.dimensions.y; y++) {
+		for(int x = 0; x < game.board.dimensions.x; x++) {
+			Coord pos(x, y);
+			Board::Field field = game.board.get_field(pos);
+			if(pos == game.player) {
+				out += (field == Board::goal ? '+' : '@');
+			} else if(field == Board::wall) {
+				out += '#';
+			} else if(field == Board::box) {
+				out += '$';
+			} else if(field == Board::box_on_goal) {
+				out += '*';
+			} else if(field == Board::goal) {
+				out += '.';
+			} else {
+				out += ' ';
+			}
+		}
+		out += '\n';
+	}
+	return out;
+}
+
+/**
+ * Write count levels generated with the given options to out, as an XSB
+ * collection. Level i (from 0) uses seed options.seed + i, so that any level
+ * can be generated again on its own. Returns false if the options do not
+ * allow for a level.
+ */
+bool generate_collection(GeneratorOptions &options, unsigned long count, FILE *out) {
+	for(unsigned long i = 0; i < count; i++) {
+		GeneratorOptions level_options = options;
+		level_options.seed = options.seed + i;
+		LevelGenerator generator(level_options);
+		Game game;
+		game.board.fields = NULL;
+		if(!generator.generate(&game)) {
+			delete[] game.board.fields;
+			return false;
+		}
+		fprintf(out, "; %lu\n%sTitle: %dx%d, %d boxes, difficulty %d, seed %lu\n\n",
+		        i + 1, board_to_xsb(game).c_str(), options.width, options.height,
+		        options.boxes, options.difficulty, level_options.seed);
+		delete[] game.board.fields;
+	}
+	return true;
+}
+
+#endif
@@ -12,7 +12,7 @@
  * closest box (without taking walls into account) that is not in the goal, and 
  * the minimum distance of all boxes to the closest goal.
  */
-struct SimpleHeuristic : Heuristic {
+struct SimpleHeuristic final : Heuristic {
 	double operator()(State &state) {
 		Game &game = static_cast<Game &>(state);
 		if(game.is_goal()) {
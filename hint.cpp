@@ -0,0 +1,204 @@
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <boost/heap/fibonacci_heap.hpp>
+#include "game.cpp"
+#include "search.cpp"
+#include "cost.cpp"
+
+#ifndef HINT_H
+#define HINT_H
+
+/** *************************************************************************
+ * Hints for Interactive Play
+ * ************************************************************************** */
+
+/**
+ * Answers "what is the best move from here?" over and over while the user
+ * plays one level, keeping what earlier searches found out:
+ *
+ * - next maps every state on a path found to be optimal to the state after
+ *   it. As long as the user follows the hints, the next hint is a lookup.
+ * - bound holds a lower bound on the moves left to the goal for every state
+ *   an earlier search expanded (exact for the states in next). A search that
+ *   finds a solution of cost C proves C - g for each state it expanded with
+ *   path cost g; one that finds none proves all of them dead (COST_INFINITY).
+ *   Later searches use the larger of this bound and the heuristic, and stop
+ *   as soon as they take a state of a known optimal path off the open list,
+ *   since the rest of the way is known from there.
+ * - The heuristic instance is kept, so its tables are built only once.
+ *
+ * Hints minimize moves. All states kept are copies owned by the engine.
+ */
+struct HintEngine {
+	typedef std::unordered_map<State *, Cost, StatePointerHash, StatePointerEqual> BoundTable;
+	typedef std::unordered_map<State *, State *, StatePointerHash, StatePointerEqual> NextTable;
+
+	Heuristic &heuristic;
+	BoundTable bound;
+	NextTable next;          // Keys and values are keys of bound
+	unsigned long n_searches;
+	unsigned long n_expanded; // Over all searches
+
+	HintEngine(Heuristic &heuristic) : heuristic(heuristic), n_searches(0), n_expanded(0) {}
+
+	~HintEngine() {
+		for(BoundTable::iterator it = this->bound.begin(); it != this->bound.end(); ++it) {
+			delete_state(it->first);
+		}
+	}
+
+	/**
+	 * The key of bound equal to state; a copy of state is added (with bound
+	 * 0) if there is none.
+	 */
+	State *intern(State &state) {
+		BoundTable::iterator it = this->bound.find(&state);
+		if(it != this->bound.end()) {
+			return it->first;
+		}
+		State *key = static_cast<Game &>(state).copy();
+		this->bound[key] = 0;
+		return key;
+	}
+
+	Cost estimate(State &state) {
+		Cost h = cost_from_heuristic(this->heuristic(state));
+		BoundTable::iterator it = this->bound.find(&state);
+		if(it != this->bound.end()) {
+			h = std::max(h, it->second);
+		}
+		return h;
+	}
+
+	/**
+	 * The number of moves left from state on an optimal path, and in *move the
+	 * first of them (L, R, U or D). Returns COST_INFINITY (and no move) if
+	 * the level cannot be solved from state anymore, 0 at the goal.
+	 */
+	Cost hint(Game &state, char *move) {
+		*move = 0;
+		if(state.is_goal()) {
+			return 0;
+		}
+		NextTable::iterator it = this->next.find(&state);
+		if(it == this->next.end()) {
+			BoundTable::iterator known = this->bound.find(&state);
+			if((known != this->bound.end() && known->second >= COST_INFINITY)
+			   || !this->search(state)) {
+				return COST_INFINITY;
+			}
+			it = this->next.find(&state);
+			assert(it != this->next.end());
+		}
+		*move = action_char(static_cast<Game *>(it->second)->player - state.player);
+		return this->bound[it->first];
+	}
+
+	/**
+	 * A* from start, as in search.cpp, with the estimates and early stop
+	 * described above. Records the optimal path found and the bounds learned.
+	 * Returns false if there is no solution.
+	 */
+	bool search(Game &start) {
+		struct Node {
+			Cost g;
+			State *parent;
+			bool closed;
+		};
+		typedef std::unordered_map<State *, Node, StatePointerHash, StatePointerEqual> NodeTable;
+		NodeTable nodes; // Keys are owned by this search
+		boost::heap::fibonacci_heap<PrioritizedState> todo;
+		State *first = start.copy();
+		Node root = {0, NULL, false};
+		nodes[first] = root;
+		todo.push(PrioritizedState(this->estimate(*first), first));
+		State *found = NULL;
+		Cost remaining = 0; // From found to the goal
+		this->n_searches++;
+
+		while(!todo.empty()) {
+			PrioritizedState top = todo.top();
+			todo.pop();
+			State *current = top.state;
+			Node &node = nodes[current];
+			if(node.closed) {
+				continue;
+			}
+			if(top.priority >= COST_INFINITY) {
+				break;
+			}
+			node.closed = true;
+			this->n_expanded++;
+			if(current->is_goal()) {
+				found = current;
+				break;
+			}
+			NextTable::iterator known = this->next.find(current);
+			if(known != this->next.end()) {
+				found = current;
+				remaining = this->bound[known->first];
+				break;
+			}
+			std::vector<State *> neighbors = current->get_neighbors();
+			for(size_t i = 0; i < neighbors.size(); i++) {
+				Cost g = node.g + 1;
+				NodeTable::iterator it = nodes.find(neighbors[i]);
+				if(it == nodes.end()) {
+					Node child = {g, current, false};
+					it = nodes.insert(std::make_pair(neighbors[i], child)).first;
+				} else {
+					delete_state(neighbors[i]);
+					if(g >= it->second.g) {
+						continue;
+					}
+					it->second.g = g;
+					it->second.parent = current;
+					it->second.closed = false;
+				}
+				Cost h = this->estimate(*it->first);
+				if(h < COST_INFINITY) {
+					todo.push(PrioritizedState(g + h, it->first));
+				}
+			}
+		}
+
+		if(found) {
+			Cost total = nodes[found].g + remaining;
+			for(NodeTable::iterator it = nodes.begin(); it != nodes.end(); ++it) {
+				if(it->second.closed && it->second.g <= total) {
+					Cost &b = this->bound[this->intern(*it->first)];
+					b = std::max(b, total - it->second.g);
+				}
+			}
+			State *after = NULL;
+			if(!this->next.count(found)) {
+				after = this->intern(*found);
+				this->bound[after] = 0;
+			} else {
+				after = this->next.find(found)->first;
+			}
+			for(State *s = nodes[found].parent; s; s = nodes[s].parent) {
+				State *key = this->intern(*s);
+				this->bound[key] = total - nodes[s].g;
+				this->next[key] = after;
+				after = key;
+			}
+		} else {
+			// The search ran out of states: nothing it expanded can be solved.
+			for(NodeTable::iterator it = nodes.begin(); it != nodes.end(); ++it) {
+				if(it->second.closed) {
+					this->bound[this->intern(*it->first)] = COST_INFINITY;
+				}
+			}
+			this->bound[this->intern(start)] = COST_INFINITY;
+		}
+
+		for(NodeTable::iterator it = nodes.begin(); it != nodes.end(); ++it) {
+			delete_state(it->first);
+		}
+		return found != NULL;
+	}
+};
+
+#endif
@@ -1,6 +1,11 @@
 #include <cstdio>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 #include <set>
 #include "game.cpp"
+#include "trace.cpp"
 
 #ifndef IO_H
 #define IO_H
@@ -21,15 +26,16 @@ typedef struct {
 /**
  * Default board characters used to encode different fields.
  */
-field_chars_t field_chars = {' ', '#', 'O', '0', '.', 'x'};
+const field_chars_t field_chars = {' ', '#', 'O', '0', '.', 'x'};
 
 /**
- * Return string visualization of the board with textual characters.
+ * Write the visualization of the board with textual characters into out (one
+ * line per row), reusing its storage.
  */
-char *board_to_string(Game &state) {
+void board_to_buffer(Game &state, std::string &out) {
 	int row_len = state.board.dimensions.x + 1; // additional char for newline
 	int len = row_len * state.board.dimensions.y;
-	char *out = new char[len+1]; // additional char for terminating null
+	out.resize(len);
 	for(int i = 0; i < len; i++) {
 		if(i % row_len == state.board.dimensions.x) {
 			out[i] = '\n';
@@ -52,19 +58,33 @@ char *board_to_string(Game &state) {
 			out[i] = field_chars.goal;
 		}
 	}
-	out[len] = '\0';
+}
+
+/**
+ * Return string visualization of the board with textual characters, newly
+ * allocated.
+ */
+char *board_to_string(Game &state) {
+	std::string viz;
+	board_to_buffer(state, viz);
+	char *out = new char[viz.size()+1]; // additional char for terminating null
+	memcpy(out, viz.c_str(), viz.size()+1);
 	return out;
 }
 
 /**
- * Create board object from string.
+ * Create board object from string. Returns 0 on success, 1 if the string is
+ * not a board (rows of equal length, each followed by a newline).
  */
 int board_from_string(char *str, Game *state) {
+	TRACE_SPAN("parse level");
 	int len = strlen(str);
-	int width = strchr(str, '\n') - str;
-	assert(width > 0);
-	assert(len % (width+1) == 0);
-	int height = len/width;
+	char *newline = strchr(str, '\n');
+	int width = (newline ? newline - str : 0);
+	if(width <= 0 || len % (width+1) != 0) {
+		return 1;
+	}
+	int height = len/(width+1);
 	Board::Field *fields = new Board::Field[width*height];
 	assert(fields != NULL);
 	state->player = Coord(0, 0);
@@ -73,14 +93,17 @@ int board_from_string(char *str, Game *state) {
 	for(int i = 0; i < len; i++) {
 		Coord pos(i % (width + 1),
 			  i / (width + 1));
-		assert(pos.x < width || str[i] == '\n');
 		if(pos.x >= width) {
+			if(str[i] != '\n') {
+				return 1;
+			}
 			continue;
 		}
 		char field = str[i];
 		if(field == field_chars.player) {
 			state->player.x = pos.x;
 			state->player.y = pos.y;
+			state->board.set_field(pos, Board::empty);
 		} else if(field == field_chars.empty) {
 			state->board.set_field(pos, Board::empty);
 		} else if(field == field_chars.wall) {
@@ -126,16 +149,29 @@ int read_coords(char *str, std::set<Coord> *coords) {
 	return pos;
 }
 
+/**
+ * Whether all coordinates lie on a board of the given dimensions.
+ */
+bool coords_in_bounds(std::set<Coord> &coords, Coord dimensions) {
+	for(std::set<Coord>::iterator it = coords.begin(); it != coords.end(); ++it) {
+		if(it->x < 0 || it->y < 0 || it->x >= dimensions.x || it->y >= dimensions.y) {
+			return false;
+		}
+	}
+	return true;
+}
+
 /**
  * Initialize board object from a file in the format as described in the project
  * manual.
  */
 int board_from_new_fmt_string(char *str, Game *state) {
+	TRACE_SPAN("parse level");
 	int pos = 0;
 	int read = 0;
 	int width = 0;
 	int height = 0;
-	if(2 != sscanf(str, "%d %d\n%n", &width, &height, &read)) {
+	if(2 != sscanf(str, "%d %d\n%n", &width, &height, &read) || width <= 0 || height <= 0) {
 		return 1;
 	}
 	pos += read;
@@ -145,7 +181,7 @@ int board_from_new_fmt_string(char *str, Game *state) {
 	std::set<Coord> walls;
 	read = read_coords(str+pos, &walls);
 	pos += read;
-	if(!read) {
+	if(!read || !coords_in_bounds(walls, state->board.dimensions)) {
 		return 1;
 	}
 	for(std::set<Coord>::iterator it = walls.begin(); it != walls.end(); ++it) {
@@ -158,7 +194,7 @@ int board_from_new_fmt_string(char *str, Game *state) {
 	std::set<Coord> boxes;
 	read = read_coords(str+pos, &boxes);
 	pos += read;
-	if(!read) {
+	if(!read || !coords_in_bounds(boxes, state->board.dimensions)) {
 		return 1;
 	}
 	if(0 != sscanf(str+pos, "\n%n", &read)) {
@@ -168,7 +204,7 @@ int board_from_new_fmt_string(char *str, Game *state) {
 	std::set<Coord> goals;
 	read = read_coords(str+pos, &goals);
 	pos += read;
-	if(!read) {
+	if(!read || !coords_in_bounds(goals, state->board.dimensions)) {
 		return 1;
 	}
 	for(std::set<Coord>::iterator it = boxes.begin(); it != boxes.end(); ++it) {
@@ -193,15 +229,24 @@ int board_from_new_fmt_string(char *str, Game *state) {
 	}
 	state->player.x -= 1;
 	state->player.y -= 1;
+	std::set<Coord> player;
+	player.insert(state->player);
+	if(!coords_in_bounds(player, state->board.dimensions)) {
+		return 1;
+	}
 	return 0;
 }
 
 /**
- * Read a file and parse it as a board.
+ * Read a file and parse it as a board. Returns 0 on success, 1 if the file
+ * cannot be read or parsed.
  */
-Game board_from_file(char *path, bool old_fmt = false) {
+int board_from_file(const char *path, Game *board, bool old_fmt = false) {
+	TRACE_SPAN("read level");
 	FILE *fp = fopen(path, "r");
-	assert(fp != NULL);
+	if(fp == NULL) {
+		return 1;
+	}
 
 	// Find file size
 	fseek(fp, 0, SEEK_END);
@@ -216,17 +261,47 @@ Game board_from_file(char *path, bool old_fmt = false) {
 	str[len] = '\0';
 
 	// Parse string
-	Game board;
 	int success;
 	if(old_fmt) {
-		success = board_from_string(str, &board);
+		success = board_from_string(str, board);
 	} else {
-		success = board_from_new_fmt_string(str, &board);
+		success = board_from_new_fmt_string(str, board);
 	}
-	assert(success == 0); // TODO better error handling
 
-	free(str);
+	delete[] str;
+	return success;
+}
+
+/**
+ * Read a file and parse it as a board.
+ */
+Game board_from_file(char *path, bool old_fmt = false) {
+	Game board;
+	int success = board_from_file(path, &board, old_fmt);
+	assert(success == 0); // TODO better error handling
 	return board;
 }
 
+/**
+ * Parse a size in bytes with an optional K, M or G suffix. Returns 0 if the
+ * string is not a valid size.
+ */
+size_t parse_size(const char *str) {
+	char *end;
+	double size = strtod(str, &end);
+	switch(*end) {
+		case 'G': case 'g':
+			size *= 1024; // fall through
+		case 'M': case 'm':
+			size *= 1024; // fall through
+		case 'K': case 'k':
+			size *= 1024;
+			end++;
+	}
+	if(*end != '\0' || size < 1) {
+		return 0;
+	}
+	return (size_t)size;
+}
+
 #endif
@@ -0,0 +1,341 @@
+#include <vector>
+#include <algorithm>
+#include "game.cpp"
+#include "trace.cpp"
+
+#ifndef LEVEL_H
+#define LEVEL_H
+
+struct DeadlockDB;
+
+/** *************************************************************************
+ * Level Analysis
+ * ************************************************************************** */
+
+/**
+ * Static properties of a level, computed once when it is loaded and shared by
+ * all states of a search. Fields are addressed by row-major board index.
+ */
+struct Level {
+	Coord dimensions;
+
+	/**
+	 * tunnel[i] has bit 0 set if field i lies in a horizontal tunnel (walls
+	 * above and below), bit 1 if it lies in a vertical one (walls to the left
+	 * and right).
+	 */
+	std::vector<unsigned char> tunnel;
+
+	/**
+	 * A goal room is an area holding all goals that can only be entered
+	 * through a single field, the entrance. goal_room[i] is set for fields
+	 * inside the room. goal_room_entrance is -1 if the level has none.
+	 */
+	std::vector<bool> goal_room;
+	int goal_room_entrance;
+
+	/**
+	 * Goals of the goal room in the order they should be filled: the goal
+	 * farthest from the entrance first, so that boxes placed earlier never
+	 * block the way for later ones.
+	 */
+	std::vector<int> goal_room_order;
+
+	/**
+	 * Whether push successors should use tunnel and goal room macros.
+	 */
+	bool macros;
+
+	/**
+	 * Whether push successors should be restricted to PI-corrals.
+	 */
+	bool corrals;
+
+	/**
+	 * Deadlock patterns learned during search, if enabled.
+	 */
+	DeadlockDB *deadlocks;
+
+	Level() : goal_room_entrance(-1), macros(false), corrals(false), deadlocks(NULL) {}
+
+	int index(Coord pos) {
+		return pos.x + this->dimensions.x * pos.y;
+	}
+
+	Coord coord(int i) {
+		return Coord(i % this->dimensions.x, i / this->dimensions.x);
+	}
+
+	bool in_bounds(Coord pos) {
+		return pos.x >= 0 && pos.y >= 0 && pos.x < this->dimensions.x
+		       && pos.y < this->dimensions.y;
+	}
+
+	/**
+	 * Whether field i has walls on both sides perpendicular to action.
+	 */
+	bool is_tunnel(int i, Coord action) {
+		return this->tunnel[i] & (action.y == 0 ? 1 : 2);
+	}
+};
+
+/**
+ * Is the given field a wall (fields outside the board count as walls)?
+ */
+bool level_is_wall(Game &game, Coord pos) {
+	if(pos.x < 0 || pos.y < 0 || pos.x >= game.board.dimensions.x
+	   || pos.y >= game.board.dimensions.y) {
+		return true;
+	}
+	return game.board.get_field(pos) == Board::wall;
+}
+
+/**
+ * Trim the board of a freshly loaded level to the part that can matter: the
+ * fields the player could ever walk on (found by a flood fill from the
+ * player through everything but walls) plus any boxes and goals outside of
+ * them, which decide whether the level is solved. Everything else becomes
+ * wall, and the board is cropped to the bounding box of what is left with
+ * one layer of walls around it (moving the player along). The moves of a
+ * solution are the same on the trimmed board.
+ *
+ * This is the same area cache_key() keeps, so the key of a level does not
+ * change by trimming it.
+ */
+void trim_board(Game &game) {
+	TRACE_SPAN("trim board");
+	Board &board = game.board;
+	int width = board.dimensions.x, height = board.dimensions.y;
+	std::vector<bool> keep(width * height, false);
+	std::vector<Coord> stack(1, game.player);
+	keep[board.get_index(game.player)] = true;
+	while(!stack.empty()) {
+		Coord pos = stack.back();
+		stack.pop_back();
+		for(int a = 0; a < 4; a++) {
+			Coord next = pos + actions[a];
+			if(level_is_wall(game, next) || keep[board.get_index(next)]) {
+				continue;
+			}
+			keep[board.get_index(next)] = true;
+			stack.push_back(next);
+		}
+	}
+	Coord min(width, height), max(-1, -1);
+	for(int i = 0; i < width * height; i++) {
+		keep[i] = keep[i] || (board.fields[i] != Board::empty && board.fields[i] != Board::wall);
+		if(keep[i]) {
+			min = Coord(std::min(min.x, i % width), std::min(min.y, i / width));
+			max = Coord(std::max(max.x, i % width), std::max(max.y, i / width));
+		}
+	}
+	Coord dimensions(max.x - min.x + 3, max.y - min.y + 3);
+	Board::Field *fields = new Board::Field[dimensions.x * dimensions.y];
+	for(int y = 0; y < dimensions.y; y++) {
+		for(int x = 0; x < dimensions.x; x++) {
+			Coord from(x + min.x - 1, y + min.y - 1);
+			bool inside = !level_is_wall(game, from) && keep[board.get_index(from)];
+			fields[x + dimensions.x * y] = (inside ? board.get_field(from) : Board::wall);
+		}
+	}
+	delete[] board.fields;
+	board.fields = fields;
+	board.dimensions = dimensions;
+	game.player = game.player - min + Coord(1, 1);
+}
+
+/**
+ * Dense numbering of the non-wall fields of a board ("cells"), for tables
+ * that only need entries for fields a box or the player can be on. Walls
+ * never change, so the numbering holds for all states of a level.
+ */
+struct CellIndex {
+	int n_cells;
+	std::vector<int> cell;      // Cell of each board index, -1 for walls
+	std::vector<int> field;     // Board index of each cell
+	std::vector<int> neighbors; // neighbors[4 * c + a]: cell next to c in direction actions[a], or -1
+
+	CellIndex() : n_cells(0) {}
+
+	CellIndex(Board &board) {
+		int n = board.dimensions.x * board.dimensions.y;
+		this->cell.assign(n, -1);
+		for(int i = 0; i < n; i++) {
+			if(board.fields[i] != Board::wall) {
+				this->cell[i] = this->field.size();
+				this->field.push_back(i);
+			}
+		}
+		this->n_cells = this->field.size();
+		this->neighbors.assign(4 * this->n_cells, -1);
+		for(int c = 0; c < this->n_cells; c++) {
+			Coord pos(this->field[c] % board.dimensions.x, this->field[c] / board.dimensions.x);
+			for(int a = 0; a < 4; a++) {
+				Coord next = pos + actions[a];
+				if(next.x >= 0 && next.y >= 0 && next.x < board.dimensions.x
+				   && next.y < board.dimensions.y) {
+					this->neighbors[4 * c + a] = this->cell[board.get_index(next)];
+				}
+			}
+		}
+	}
+};
+
+/**
+ * Mark tunnel fields: fields that have walls on both sides perpendicular to
+ * the direction of travel. A box pushed along a tunnel can neither be moved
+ * sideways nor passed by the player.
+ */
+void find_tunnels(Game &game, Level *level) {
+	int n = level->dimensions.x * level->dimensions.y;
+	level->tunnel.assign(n, 0);
+	for(int i = 0; i < n; i++) {
+		Coord pos = level->coord(i);
+		if(game.board.fields[i] == Board::wall) {
+			continue;
+		}
+		if(level_is_wall(game, pos + Coord(0, -1))
+		   && level_is_wall(game, pos + Coord(0, +1))) {
+			level->tunnel[i] |= 1;
+		}
+		if(level_is_wall(game, pos + Coord(-1, 0))
+		   && level_is_wall(game, pos + Coord(+1, 0))) {
+			level->tunnel[i] |= 2;
+		}
+	}
+}
+
+/**
+ * Find the smallest goal room: an area that contains every goal but neither
+ * the player nor a box that is not yet on a goal, and that is cut off from
+ * the rest of the level when a single (non-goal) entrance field is removed.
+ * Only fields the player can walk to, ignoring boxes, are considered.
+ *
+ * A single depth-first search from the player finds all such cuts: removing
+ * field e cuts the search subtree of its child c off from the rest exactly
+ * if no field in that subtree has an edge back to a field visited before e
+ * (Tarjan's articulation points). The subtree of c is then a candidate room,
+ * and since subtrees are contiguous in visiting order, its goals and boxes
+ * are counted from prefix sums.
+ */
+void find_goal_room(Game &game, Level *level) {
+	int n = level->dimensions.x * level->dimensions.y;
+	level->goal_room.assign(n, false);
+	level->goal_room_entrance = -1;
+	level->goal_room_order.clear();
+	std::vector<int> goals;
+	for(int i = 0; i < n; i++) {
+		if(game.board.fields[i] == Board::goal || game.board.fields[i] == Board::box_on_goal) {
+			goals.push_back(i);
+		}
+	}
+	if(goals.empty()) {
+		return;
+	}
+	int player = level->index(game.player);
+	std::vector<int> order(n, -1), low(n), last(n), parent(n, -1);
+	std::vector<int> visited;                      // Fields in visiting order
+	std::vector<std::pair<int, int> > stack;       // Field, next action
+	order[player] = low[player] = 0;
+	visited.push_back(player);
+	stack.push_back(std::make_pair(player, 0));
+	while(!stack.empty()) {
+		int v = stack.back().first;
+		if(stack.back().second == 4) {
+			stack.pop_back();
+			last[v] = visited.size() - 1;
+			if(parent[v] != -1) {
+				low[parent[v]] = std::min(low[parent[v]], low[v]);
+			}
+			continue;
+		}
+		Coord next = level->coord(v) + actions[stack.back().second++];
+		if(level_is_wall(game, next)) {
+			continue;
+		}
+		int w = level->index(next);
+		if(order[w] == -1) {
+			parent[w] = v;
+			order[w] = low[w] = visited.size();
+			visited.push_back(w);
+			stack.push_back(std::make_pair(w, 0));
+		} else if(w != parent[v]) {
+			low[v] = std::min(low[v], order[w]);
+		}
+	}
+	// n_goals[k], n_boxes[k]: goals and boxes off goals among the first k
+	// visited fields.
+	std::vector<int> n_goals(visited.size() + 1, 0), n_boxes(visited.size() + 1, 0);
+	for(size_t k = 0; k < visited.size(); k++) {
+		Board::Field field = game.board.fields[visited[k]];
+		n_goals[k + 1] = n_goals[k] + (field == Board::goal || field == Board::box_on_goal);
+		n_boxes[k + 1] = n_boxes[k] + (field == Board::box);
+	}
+	int best_size = n + 1;
+	int room = -1;
+	for(size_t k = 1; k < visited.size(); k++) {
+		int c = visited[k];
+		int e = parent[c];
+		if(game.board.fields[e] != Board::empty || low[c] < order[e]) {
+			continue;
+		}
+		int size = last[c] - order[c] + 1;
+		if(n_goals[last[c] + 1] - n_goals[order[c]] != (int)goals.size()
+		   || n_boxes[last[c] + 1] - n_boxes[order[c]] != 0) {
+			continue;
+		}
+		if(size < best_size || (size == best_size && e < level->goal_room_entrance)) {
+			best_size = size;
+			level->goal_room_entrance = e;
+			room = c;
+		}
+	}
+	if(room != -1) {
+		for(int k = order[room]; k <= last[room]; k++) {
+			level->goal_room[visited[k]] = true;
+		}
+	}
+	if(level->goal_room_entrance == -1) {
+		return;
+	}
+
+	// Order goals by decreasing walking distance from the entrance.
+	std::vector<int> distance(n, -1);
+	std::vector<int> todo;
+	todo.push_back(level->goal_room_entrance);
+	distance[todo[0]] = 0;
+	for(size_t k = 0; k < todo.size(); k++) {
+		Coord pos = level->coord(todo[k]);
+		for(int a = 0; a < 4; a++) {
+			Coord next = pos + actions[a];
+			if(level_is_wall(game, next)) {
+				continue;
+			}
+			int j = level->index(next);
+			if(!level->goal_room[j] || distance[j] != -1) {
+				continue;
+			}
+			distance[j] = distance[todo[k]] + 1;
+			todo.push_back(j);
+		}
+	}
+	level->goal_room_order = goals;
+	std::stable_sort(level->goal_room_order.begin(), level->goal_room_order.end(),
+	                 [&distance](int a, int b) {
+		return distance[a] > distance[b];
+	});
+}
+
+/**
+ * Analyze the level given by its start state.
+ */
+Level *analyze_level(Game &start) {
+	TRACE_SPAN("analyze level");
+	Level *level = new Level();
+	level->dimensions = start.board.dimensions;
+	find_tunnels(start, level);
+	find_goal_room(start, level);
+	return level;
+}
+
+#endif
@@ -0,0 +1,317 @@
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <new>
+#include "libsokoban.h"
+
+// Every header the modules include, so that including the modules inside
+// the namespace below does not pull any of them into it.
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdlib.h>
+#include <strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/heap/fibonacci_heap.hpp>
+#include <boost/numeric/ublas/matrix.hpp>
+
+// The solver's own names (State, Game, A_star, search_stats, ...) are kept
+// in a namespace of their own, so that they cannot clash with those of a
+// program the static library is linked into.
+namespace libsokoban {
+#include "game.cpp"
+#include "io.cpp"
+#include "search.cpp"
+#include "heuristic.cpp"
+#include "mincostheuristic.cpp"
+#include "cost.cpp"
+#include "level.cpp"
+#include "pushgame.cpp"
+#include "dispatch.cpp"
+#include "beamsearch.cpp"
+#include "smastar.cpp"
+#include "collection.cpp"
+#include "cache.cpp"
+#include "batch.cpp"
+}
+
+using namespace libsokoban;
+
+/** *************************************************************************
+ * libsokoban
+ *
+ * The C interface declared in libsokoban.h, built as a library of its own
+ * (make libsokoban.a libsokoban.so). Everything a solve needs lives in the
+ * solver handle; the modules included above keep no mutable global state.
+ * ************************************************************************** */
+
+#define SOKOBAN_ASTAR   0
+#define SOKOBAN_BEAM    1
+#define SOKOBAN_SMASTAR 2
+
+struct sokoban_solver {
+	Game board;
+	bool loaded;
+
+	// Options
+	bool simple_heuristic;
+	int algorithm;
+	std::string cost;
+	size_t beam_width;
+	size_t max_memory;    // SMA* budget
+	SearchLimits limits;  // A* limits (and cancellation)
+	bool macros;
+	bool corrals;
+	bool partial;         // A* partial expansion
+	std::atomic<bool> cancel;
+
+	// Kept between solves of the same level
+	Heuristic *heuristic;
+
+	// Result of the last solve
+	std::string moves;
+	unsigned long pushes;
+	unsigned long expansions;
+};
+
+/**
+ * Forget the loaded level along with everything computed for it.
+ */
+static void sokoban_unload(sokoban_solver *solver) {
+	delete solver->heuristic;
+	delete solver->board.level;
+	delete[] solver->board.board.fields;
+	solver->heuristic = NULL;
+	solver->board.level = NULL;
+	solver->board.board.fields = NULL;
+	solver->loaded = false;
+}
+
+/**
+ * Search with the algorithm chosen in solver, from start (a Game or a
+ * PushGame).
+ */
+static std::vector<State *> sokoban_search(sokoban_solver *solver, State &start, CostModel *cost) {
+	if(solver->algorithm == SOKOBAN_BEAM) {
+		return beam_search(start, *solver->heuristic, solver->beam_width, false);
+	} else if(solver->algorithm == SOKOBAN_SMASTAR) {
+		return SMA_star(start, *solver->heuristic, solver->max_memory, false, cost);
+	}
+	return A_star(start, *solver->heuristic, false, cost, NULL, &solver->limits, solver->partial);
+}
+
+extern "C" {
+
+sokoban_solver *sokoban_new(void) {
+	sokoban_solver *solver = new (std::nothrow) sokoban_solver();
+	if(!solver) {
+		return NULL;
+	}
+	solver->board.board.fields = NULL;
+	solver->loaded = false;
+	solver->simple_heuristic = false;
+	solver->algorithm = SOKOBAN_ASTAR;
+	solver->cost = "moves";
+	solver->beam_width = 1000;
+	solver->max_memory = (size_t)1 << 30;
+	solver->macros = false;
+	solver->corrals = false;
+	solver->partial = false;
+	solver->cancel = false;
+	solver->limits.cancel = &solver->cancel;
+	solver->heuristic = NULL;
+	solver->pushes = 0;
+	solver->expansions = 0;
+	return solver;
+}
+
+int sokoban_load(sokoban_solver *solver, const char *text, size_t size, sokoban_format format) {
+	static const char *formats[] = {"auto", "xsb", "coords", "visual"};
+	sokoban_unload(solver);
+	solver->moves.clear();
+	if(format < SOKOBAN_FORMAT_AUTO || format > SOKOBAN_FORMAT_VISUAL
+	   || board_from_text(std::string(text, size), formats[format], &solver->board) != 0) {
+		delete[] solver->board.board.fields;
+		solver->board.board.fields = NULL;
+		return -1;
+	}
+	trim_board(solver->board);
+	solver->loaded = true;
+	return 0;
+}
+
+int sokoban_set_option(sokoban_solver *solver, const char *name, const char *value) {
+	std::string option(name);
+	if(option == "heuristic" && (!strcmp(value, "simple") || !strcmp(value, "mincost"))) {
+		if(solver->simple_heuristic != !strcmp(value, "simple")) {
+			delete solver->heuristic;
+			solver->heuristic = NULL;
+		}
+		solver->simple_heuristic = !strcmp(value, "simple");
+	} else if(option == "algorithm" && !strcmp(value, "astar")) {
+		solver->algorithm = SOKOBAN_ASTAR;
+	} else if(option == "algorithm" && !strcmp(value, "beam")) {
+		solver->algorithm = SOKOBAN_BEAM;
+	} else if(option == "algorithm" && !strcmp(value, "smastar")) {
+		solver->algorithm = SOKOBAN_SMASTAR;
+	} else if(option == "cost") {
+		CostModel *cost = cost_model_from_name(value);
+		if(!cost) {
+			return -1;
+		}
+		delete cost;
+		solver->cost = value;
+	} else if(option == "beam-width" && strtoul(value, NULL, 10) > 0) {
+		solver->beam_width = strtoul(value, NULL, 10);
+	} else if(option == "max-mem" && parse_size(value)) {
+		solver->max_memory = parse_size(value);
+	} else if(option == "time-limit" && atof(value) >= 0) {
+		solver->limits.max_seconds = atof(value);
+	} else if(option == "mem-limit" && (!strcmp(value, "0") || parse_size(value))) {
+		solver->limits.max_memory = parse_size(value);
+	} else if((option == "macros" || option == "corrals")
+	          && (!strcmp(value, "0") || !strcmp(value, "1"))) {
+		(option == "macros" ? solver->macros : solver->corrals) = !strcmp(value, "1");
+		delete solver->board.level; // Analyzed again on the next solve
+		solver->board.level = NULL;
+	} else if(option == "partial-expansion" && (!strcmp(value, "0") || !strcmp(value, "1"))) {
+		solver->partial = !strcmp(value, "1");
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+sokoban_status sokoban_solve(sokoban_solver *solver, sokoban_progress_fn progress, void *data) {
+	solver->moves.clear();
+	solver->pushes = 0;
+	solver->expansions = 0;
+	if(!solver->loaded) {
+		return SOKOBAN_ERROR;
+	}
+	CostModel *cost = cost_model_from_name(solver->cost.c_str());
+	if((solver->macros || solver->corrals) && !cost->push_graph()) {
+		delete cost;
+		return SOKOBAN_ERROR;
+	}
+	if(!solver->heuristic) {
+		if(solver->simple_heuristic) {
+			solver->heuristic = new SimpleHeuristic();
+		} else {
+			solver->heuristic = new MinCostHeuristic();
+		}
+	}
+	if((solver->macros || solver->corrals) && !solver->board.level) {
+		solver->board.level = analyze_level(solver->board);
+		solver->board.level->macros = solver->macros;
+		solver->board.level->corrals = solver->corrals;
+	}
+	solver->cancel = false;
+	solver->limits.started = std::chrono::steady_clock::now();
+	solver->limits.progress = NULL;
+	solver->limits.timed_out = false;
+	solver->limits.out_of_memory = false;
+	solver->limits.cancelled = false;
+	solver->limits.n_expanded = 0;
+	struct Progress {
+		sokoban_progress_fn function;
+		void *data;
+		static bool call(void *progress, unsigned long expansions, double seconds) {
+			Progress *p = static_cast<Progress *>(progress);
+			return p->function(p->data, expansions, seconds) != 0;
+		}
+	} callback = {progress, data};
+	if(progress) {
+		solver->limits.progress = &Progress::call;
+		solver->limits.progress_data = &callback;
+	}
+
+	Game &board = solver->board;
+	std::vector<State *> solution;
+	if(cost->push_graph()) {
+		PushGame start(board);
+		std::vector<State *> pushes = sokoban_search(solver, start, cost);
+		solution = expand_push_solution(board, pushes);
+		for(size_t i = 0; i < pushes.size(); i++) {
+			if(pushes[i] != &start) {
+				delete_state(pushes[i]);
+			}
+		}
+		delete[] start.board.fields;
+	} else {
+		solution = sokoban_search(solver, board, cost);
+	}
+	delete cost;
+
+	solver->moves = solution_to_moves(solution);
+	for(size_t i = 1; i < solution.size(); i++) {
+		Game *current = static_cast<Game *>(solution[i]);
+		solver->pushes += current->edge_pushes(*static_cast<Game *>(solution[i-1]));
+	}
+	for(size_t i = 0; i < solution.size(); i++) {
+		if(solution[i] != &board) {
+			delete_state(solution[i]);
+		}
+	}
+	solver->expansions = solver->limits.n_expanded;
+	if(!solution.empty()) {
+		return SOKOBAN_SOLVED;
+	} else if(solver->limits.timed_out) {
+		return SOKOBAN_TIMEOUT;
+	} else if(solver->limits.out_of_memory) {
+		return SOKOBAN_MEMOUT;
+	} else if(solver->limits.cancelled) {
+		return SOKOBAN_CANCELLED;
+	} else if(solver->algorithm != SOKOBAN_ASTAR) {
+		return SOKOBAN_NOT_FOUND;
+	}
+	return SOKOBAN_UNSOLVABLE;
+}
+
+void sokoban_cancel(sokoban_solver *solver) {
+	solver->cancel = true;
+}
+
+const char *sokoban_solution(sokoban_solver *solver) {
+	return solver->moves.c_str();
+}
+
+unsigned long sokoban_pushes(sokoban_solver *solver) {
+	return solver->pushes;
+}
+
+unsigned long sokoban_expansions(sokoban_solver *solver) {
+	return solver->expansions;
+}
+
+void sokoban_free(sokoban_solver *solver) {
+	if(solver) {
+		sokoban_unload(solver);
+		delete solver;
+	}
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef LIBSOKOBAN_H
+#define LIBSOKOBAN_H
+
+#include <stddef.h>
+
+/** *************************************************************************
+ * libsokoban: C interface to the solver
+ *
+ * A solver handle holds one level, the options for solving it, and the
+ * result of the last solve. Handles are independent of each other; several
+ * of them may be used on different threads at the same time. A single handle
+ * must only be used by one thread at a time, except for sokoban_cancel.
+ * ************************************************************************** */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define SOKOBAN_API __attribute__((visibility("default")))
+#else
+#define SOKOBAN_API
+#endif
+
+typedef struct sokoban_solver sokoban_solver;
+
+/**
+ * Input formats, see README.md. SOKOBAN_FORMAT_AUTO guesses the format from
+ * the text.
+ */
+typedef enum {
+	SOKOBAN_FORMAT_AUTO,
+	SOKOBAN_FORMAT_XSB,
+	SOKOBAN_FORMAT_COORDS,
+	SOKOBAN_FORMAT_VISUAL
+} sokoban_format;
+
+/**
+ * Outcome of a solve. SOKOBAN_UNSOLVABLE is only returned by A*, which has
+ * then searched the whole level; beam search and SMA* return
+ * SOKOBAN_NOT_FOUND if they give up.
+ */
+typedef enum {
+	SOKOBAN_SOLVED,
+	SOKOBAN_UNSOLVABLE,
+	SOKOBAN_NOT_FOUND,
+	SOKOBAN_TIMEOUT,
+	SOKOBAN_MEMOUT,
+	SOKOBAN_CANCELLED,
+	SOKOBAN_ERROR
+} sokoban_status;
+
+/**
+ * Called about every thousand expansions during A* search with the number of
+ * expansions and seconds so far. Returning 0 cancels the search.
+ */
+typedef int (*sokoban_progress_fn)(void *data, unsigned long expansions, double seconds);
+
+/**
+ * Create a solver with default options (A*, minimum cost heuristic,
+ * minimizing moves, no limits). Returns NULL if out of memory.
+ */
+SOKOBAN_API sokoban_solver *sokoban_new(void);
+
+/**
+ * Load a level from size bytes of text. For XSB text holding several levels,
+ * the first one is taken. Returns 0 on success, -1 if the text cannot be
+ * parsed (any previously loaded level is gone then).
+ */
+SOKOBAN_API int sokoban_load(sokoban_solver *solver, const char *text, size_t size,
+                             sokoban_format format);
+
+/**
+ * Set an option, named like the command line options:
+ *
+ *     heuristic    simple | mincost
+ *     algorithm    astar | beam | smastar
+ *     cost         moves | pushes | pushes-moves | moves-pushes
+ *     beam-width   states per layer for beam search (default 1000)
+ *     max-mem      memory budget for SMA* (with K, M, G suffix)
+ *     time-limit   seconds, for A* (0 for none)
+ *     mem-limit    bytes of stored states, for A* (0 for none)
+ *     macros       1 to use macro moves (with cost pushes), 0 not to
+ *     corrals      1 to prune pushes to PI-corrals (with cost pushes), 0 not to
+ *     partial-expansion
+ *                  1 for A* with partial expansion (less memory), 0 not to
+ *
+ * Returns 0 on success, -1 for an unknown option or invalid value.
+ */
+SOKOBAN_API int sokoban_set_option(sokoban_solver *solver, const char *name, const char *value);
+
+/**
+ * Solve the loaded level. progress may be NULL; it is only called by A*.
+ */
+SOKOBAN_API sokoban_status sokoban_solve(sokoban_solver *solver, sokoban_progress_fn progress,
+                                         void *data);
+
+/**
+ * Ask a running sokoban_solve (on another thread) to give up. It returns
+ * SOKOBAN_CANCELLED soon after. Only A* searches can be cancelled.
+ */
+SOKOBAN_API void sokoban_cancel(sokoban_solver *solver);
+
+/**
+ * The moves of the last solution (letters L, R, U, D), or an empty string.
+ * Valid until the next call of sokoban_solve, sokoban_load or sokoban_free.
+ */
+SOKOBAN_API const char *sokoban_solution(sokoban_solver *solver);
+
+/**
+ * Statistics of the last solve.
+ */
+SOKOBAN_API unsigned long sokoban_pushes(sokoban_solver *solver);
+SOKOBAN_API unsigned long sokoban_expansions(sokoban_solver *solver);
+
+SOKOBAN_API void sokoban_free(sokoban_solver *solver);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
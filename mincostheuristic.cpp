@@ -12,16 +12,19 @@
 #include "game.cpp"
 #include "search.cpp"
 #include "io.cpp"
+#include "level.cpp"
 #include "Hungarian.h"
 #include "Hungarian.cpp"
+#include "trace.cpp"
 
 //2147483647
 
 using namespace boost::numeric::ublas;
 
-struct MinCostHeuristic: Heuristic
+struct MinCostHeuristic final : Heuristic
 {
     bool start;
+	CellIndex cells;
 	matrix<int> reverse_directed_graph;
 	std::map<int, Coord> key_to_coord;
 	std::map<Coord, int> coord_to_key;
@@ -58,23 +61,25 @@ struct MinCostHeuristic: Heuristic
 		}
 	}
 
+	// Keys are the cells of the board (see CellIndex), so walls take no
+	// space in any of the tables.
 	void build_key_to_coord(State &state)
 	{	
 		Game &game = static_cast<Game &>(state);
-		for (int i = 0; i < game.board.dimensions.x; ++i)
+		cells = CellIndex(game.board);
+		for (int c = 0; c < cells.n_cells; ++c)
 		{
-			for (int j = 0; j < game.board.dimensions.y; ++j)
+			Coord pos(cells.field[c] % game.board.dimensions.x, cells.field[c] / game.board.dimensions.x);
+			key_to_coord.insert({c, pos});
+			coord_to_key.insert({pos, c});
+			Board::Field field = game.board.fields[cells.field[c]];
+			if (field == Board::goal || field == Board::box_on_goal)
 			{
-				key_to_coord.insert({game.board.get_index(Coord(i, j)), Coord(i, j)});
-				coord_to_key.insert({Coord(i, j), game.board.get_index(Coord(i, j))});
-				if (game.board.get_field(Coord(i, j)) == 4 || game.board.get_field(Coord(i, j)) == 3)
-				{
-					goal_keys.push_back(coord_to_key.at(Coord(i, j)));
-				}
-				if (game.board.get_field(Coord(i, j)) == 2 || game.board.get_field(Coord(i, j)) == 3)
-				{
-					box_keys.push_back(coord_to_key.at(Coord(i, j)));
-				}
+				goal_keys.push_back(c);
+			}
+			if (field == Board::box || field == Board::box_on_goal)
+			{
+				box_keys.push_back(c);
 			}
 		}
 		//display_key_to_coord(game);
@@ -85,17 +90,15 @@ struct MinCostHeuristic: Heuristic
 		std::vector<int> new_box_keys;
 		bool box_moved = false;
 		Game &game = static_cast<Game &>(state);
-		for (int i = 0; i < game.board.dimensions.x; ++i)
+		for (int c = 0; c < cells.n_cells; ++c)
 		{
-			for (int j = 0; j < game.board.dimensions.y; ++j)
+			Board::Field field = game.board.fields[cells.field[c]];
+			if (field == Board::box || field == Board::box_on_goal)
 			{
-				if (game.board.get_field(Coord(i, j)) == 2 || game.board.get_field(Coord(i, j)) == 3)
+				new_box_keys.push_back(c);
+				if (std::find(box_keys.begin(), box_keys.end(), c) == box_keys.end())
 				{
-					new_box_keys.push_back(coord_to_key.at(Coord(i, j)));
-					if (std::find(box_keys.begin(), box_keys.end(), coord_to_key.at(Coord(i, j))) == box_keys.end())
-					{
-						box_moved = true;
-					}
+					box_moved = true;
 				}
 			}
 		}
@@ -288,7 +291,6 @@ struct MinCostHeuristic: Heuristic
 	void build_box_goal_adjacency(State& state)
 	{
 		//std::cout << "Entered build_box_goal_adjacency\n";
-		Game &game = static_cast<Game &>(state);
 		box_goal_adjacency = matrix<int>(box_keys.size(), goal_keys.size());
 		//std::cout << "Created box-goal matrix\n";
 		for (unsigned i = 0; i < goal_keys.size(); i++)
@@ -307,11 +309,8 @@ struct MinCostHeuristic: Heuristic
 			for (unsigned b = 0; b < box_keys.size(); b++)
 			{
 				//std::cout << "For box:" << b << '\n';
-				Coord box_coord = key_to_coord.at(box_keys.at(b));
-				Coord goal_coord = key_to_coord.at(goal_keys.at(g));
-
-				int box_graph_key = game.board.get_index(box_coord);
-				int goal_graph_key = game.board.get_index(goal_coord);
+				int box_graph_key = box_keys.at(b);
+				int goal_graph_key = goal_keys.at(g);
 
 				if (box_graph_to_adj_key.find(box_graph_key) != box_graph_to_adj_key.end())
 				{
@@ -346,6 +345,7 @@ struct MinCostHeuristic: Heuristic
 
 	void minimum_cost()
 	{
+		TRACE_SPAN("assignment");
 		std::vector<std::vector<double> > cost_matrix;
 		for (unsigned i = 0; i < box_goal_adjacency.size1(); ++i)
 		{
@@ -373,6 +373,7 @@ struct MinCostHeuristic: Heuristic
 
 		if(start)
 		{
+			TRACE_SPAN("heuristic tables");
 			start = false;
 			build_key_to_coord(game);
 			//std::cout << "Built key_to_coord\n";
@@ -393,8 +394,9 @@ struct MinCostHeuristic: Heuristic
 			}
 			else 
 			{
-				build_reverse_directed_graph(game);
-				build_distances_to_goals();
+				// Box-to-goal distances only depend on the walls and were
+				// computed on the first call; rebuilding the graph and
+				// distances here only appended unused tables.
 				build_box_goal_adjacency(game);
 				minimum_cost();
 			}
@@ -0,0 +1,211 @@
+#include <cstring>
+#include <cassert>
+#include <vector>
+#include <unordered_map>
+#include "game.cpp"
+#include "level.cpp"
+
+#ifndef PACK_H
+#define PACK_H
+
+/** *************************************************************************
+ * Compact State Encoding
+ * ************************************************************************** */
+
+/**
+ * Walls and goals never change during a game, so a state is fully described
+ * by the player position and the set of fields that hold a box. The packer
+ * keeps a copy of the static part of the board (all boxes removed) and
+ * encodes states as a fixed-size byte string:
+ *
+ *     [player index, 4 bytes little endian][one bit per cell: box or not]
+ *
+ * with cells numbered as in CellIndex, so walls take no space.
+ *
+ * Packed states compare with memcmp, which makes them suitable for sorting
+ * and for writing to disk.
+ */
+struct StatePacker {
+	Board base;
+	int n_fields;
+	CellIndex cells;
+	size_t size;
+
+	StatePacker() {}
+
+	StatePacker(Game &start) : base(start.board) {
+		this->n_fields = base.dimensions.x * base.dimensions.y;
+		for(int i = 0; i < this->n_fields; i++) {
+			if(this->base.fields[i] == Board::box) {
+				this->base.fields[i] = Board::empty;
+			} else if(this->base.fields[i] == Board::box_on_goal) {
+				this->base.fields[i] = Board::goal;
+			}
+		}
+		this->cells = CellIndex(this->base);
+		this->size = 4 + (this->cells.n_cells + 7) / 8;
+	}
+
+	/**
+	 * Write the packed representation of state to out, which must hold at
+	 * least this->size bytes.
+	 */
+	void pack(Game &state, unsigned char *out) {
+		unsigned int player = state.board.get_index(state.player);
+		out[0] = player & 0xff;
+		out[1] = (player >> 8) & 0xff;
+		out[2] = (player >> 16) & 0xff;
+		out[3] = (player >> 24) & 0xff;
+		memset(out + 4, 0, this->size - 4);
+		for(int c = 0; c < this->cells.n_cells; c++) {
+			Board::Field field = state.board.fields[this->cells.field[c]];
+			if(field == Board::box || field == Board::box_on_goal) {
+				out[4 + c / 8] |= 1 << (c % 8);
+			}
+		}
+	}
+
+	/**
+	 * Restore a game state from its packed representation. The returned
+	 * game owns a freshly allocated board.
+	 */
+	Game unpack(const unsigned char *in) {
+		Game state;
+		state.board.dimensions = this->base.dimensions;
+		state.board.fields = new Board::Field[this->n_fields];
+		this->unpack_into(state, in);
+		return state;
+	}
+
+	/**
+	 * Overwrite player and boxes of an existing state (whose board has the
+	 * right dimensions) with the packed state.
+	 */
+	void unpack_into(Game &state, const unsigned char *in) {
+		memcpy(state.board.fields, this->base.fields,
+		       sizeof(Board::Field) * this->n_fields);
+		unsigned int player = in[0] | (in[1] << 8) | (in[2] << 16)
+		                      | ((unsigned int)in[3] << 24);
+		state.player = Coord(player % this->base.dimensions.x,
+		                     player / this->base.dimensions.x);
+		for(int c = 0; c < this->cells.n_cells; c++) {
+			if(!(in[4 + c / 8] & (1 << (c % 8)))) {
+				continue;
+			}
+			int i = this->cells.field[c];
+			if(state.board.fields[i] == Board::goal) {
+				state.board.fields[i] = Board::box_on_goal;
+			} else {
+				state.board.fields[i] = Board::box;
+			}
+		}
+	}
+
+};
+
+/**
+ * Board size classes. Most levels have few enough non-wall cells that the set
+ * of boxes fits in one or a handful of machine words; a search specialized on
+ * that number of words (the template parameter WORDS below) compares, hashes
+ * and copies box sets in a fixed number of word operations that the compiler
+ * unrolls, instead of looping over the whole board. size_class_words() gives
+ * the class a level belongs to, 0 standing for "too large, use the generic
+ * representation".
+ */
+#define SIZE_CLASS_MAX_CELLS 1024
+
+int size_class_words(int n_cells) {
+	if(n_cells <= 64) {
+		return 1;
+	} else if(n_cells <= 128) {
+		return 2;
+	} else if(n_cells <= 256) {
+		return 4;
+	} else if(n_cells <= SIZE_CLASS_MAX_CELLS) {
+		return SIZE_CLASS_MAX_CELLS / 64;
+	}
+	return 0;
+}
+
+/**
+ * A state of a level with at most 64 * WORDS cells: the player's board index
+ * and one bit per cell (as in CellIndex) for the boxes.
+ */
+template<int WORDS>
+struct PackedKey {
+	unsigned long long boxes[WORDS];
+	int player;
+
+	bool operator==(const PackedKey &other) const {
+		for(int w = 0; w < WORDS; w++) {
+			if(this->boxes[w] != other.boxes[w]) {
+				return false;
+			}
+		}
+		return this->player == other.player;
+	}
+};
+
+template<int WORDS>
+struct PackedKeyHash {
+	size_t operator()(const PackedKey<WORDS> &key) const {
+		unsigned long long hash = (unsigned int)key.player * 0x9e3779b97f4a7c15ULL;
+		for(int w = 0; w < WORDS; w++) {
+			hash = (hash ^ key.boxes[w]) * 0xff51afd7ed558ccdULL;
+			hash ^= hash >> 32;
+		}
+		return (size_t)hash;
+	}
+};
+
+/**
+ * Set of distinct game states of one level, keyed by PackedKey<WORDS>. It is
+ * used in place of PointerSet<Game> when the level falls into a size class,
+ * and has the same interface: intern() stores a state unless an equal one is
+ * stored already, and returns the stored one.
+ */
+template<int WORDS>
+struct PackedStateSet {
+	typedef std::unordered_map<PackedKey<WORDS>, Game *, PackedKeyHash<WORDS> > Table;
+
+	CellIndex cells;
+	Table data;
+
+	PackedStateSet(Board &board) : cells(board) {
+		assert(this->cells.n_cells <= 64 * WORDS);
+	}
+
+	PackedKey<WORDS> key(Game &state) {
+		PackedKey<WORDS> key;
+		memset(&key, 0, sizeof(key));
+		key.player = state.board.get_index(state.player);
+		for(int c = 0; c < this->cells.n_cells; c++) {
+			Board::Field field = state.board.fields[this->cells.field[c]];
+			if(field == Board::box || field == Board::box_on_goal) {
+				key.boxes[c / 64] |= 1ULL << (c % 64);
+			}
+		}
+		return key;
+	}
+
+	/**
+	 * The stored state equal to state, or NULL.
+	 */
+	Game *find(Game &state) {
+		typename Table::iterator it = this->data.find(this->key(state));
+		return (it == this->data.end() ? NULL : it->second);
+	}
+
+	Game *intern(Game *state) {
+		return this->data.insert(std::make_pair(this->key(*state), state)).first->second;
+	}
+
+	template<typename F>
+	void for_each(F f) {
+		for(typename Table::iterator it = this->data.begin(); it != this->data.end(); ++it) {
+			f(it->second);
+		}
+	}
+};
+
+#endif
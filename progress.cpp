@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <string>
+#include <chrono>
+#include <unistd.h>
+#include "game.cpp"
+#include "io.cpp"
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+/** *************************************************************************
+ * Progress Display
+ * ************************************************************************** */
+
+/**
+ * Draws a board followed by a status line, over and over, to a stream. On a
+ * terminal, only the cells that changed since the last frame are redrawn,
+ * using ANSI cursor movement; otherwise every frame is printed in full,
+ * followed by a blank line. The board is rendered into a buffer kept from
+ * frame to frame, so drawing does not allocate once the first frame is out.
+ */
+struct BoardRenderer {
+	FILE *out;
+	bool ansi;
+	std::string frame;  // Board being drawn
+	std::string shown;  // Board on screen (ANSI mode)
+	std::string buffer; // Output of one frame
+	Coord dimensions;   // Of the board on screen, (-1, -1) if none
+
+	BoardRenderer(FILE *out) : out(out), ansi(isatty(fileno(out))), dimensions(-1, -1) {}
+
+	void draw(Game &state, const char *status) {
+		board_to_buffer(state, this->frame);
+		this->buffer.clear();
+		if(!this->ansi || !(state.board.dimensions == this->dimensions)) {
+			this->buffer += this->frame;
+			this->buffer += status;
+			this->buffer += (this->ansi ? "\n" : "\n\n");
+		} else {
+			// Back to the top left of the frame on screen, then rewrite the
+			// changed runs of each row and the status line.
+			char move[32];
+			snprintf(move, sizeof(move), "\033[%dA\r", state.board.dimensions.y + 1);
+			this->buffer += move;
+			int row_len = state.board.dimensions.x + 1;
+			for(int y = 0; y < state.board.dimensions.y; y++) {
+				int x = 0;
+				while(x < state.board.dimensions.x) {
+					int i = y * row_len + x;
+					if(this->frame[i] == this->shown[i]) {
+						x++;
+						continue;
+					}
+					snprintf(move, sizeof(move), "\033[%dG", x + 1);
+					this->buffer += move;
+					while(x < state.board.dimensions.x
+					      && this->frame[y * row_len + x] != this->shown[y * row_len + x]) {
+						this->buffer += this->frame[y * row_len + x];
+						x++;
+					}
+				}
+				this->buffer += '\n';
+			}
+			this->buffer += "\033[K";
+			this->buffer += status;
+			this->buffer += '\n';
+		}
+		fwrite(this->buffer.data(), 1, this->buffer.size(), this->out);
+		fflush(this->out);
+		this->shown.swap(this->frame);
+		this->dimensions = state.board.dimensions;
+	}
+};
+
+/**
+ * Seconds between two progress reports of a search, and iterations between
+ * two looks at the clock.
+ */
+#define PROGRESS_INTERVAL 0.5
+#define PROGRESS_CLOCK_EVERY 256
+
+/**
+ * Periodic progress report of a search: the best state found so far (lowest
+ * heuristic value) and a few statistics. The search only remembers which
+ * state is best; the clock is looked at every PROGRESS_CLOCK_EVERY iterations,
+ * and a report drawn at most every PROGRESS_INTERVAL seconds, so reporting
+ * does not slow the search down noticeably however often the best state
+ * changes.
+ */
+struct SearchProgress {
+	BoardRenderer renderer;
+	std::chrono::steady_clock::time_point started;
+	std::chrono::steady_clock::time_point last;
+	char status[160];
+
+	SearchProgress(FILE *out) : renderer(out), started(std::chrono::steady_clock::now()),
+		last(started) {}
+
+	double seconds() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now()
+		                                     - this->started).count();
+	}
+
+	/**
+	 * Whether a report is due at the given iteration.
+	 */
+	bool due(unsigned long iteration) {
+		if(iteration % PROGRESS_CLOCK_EVERY != 0) {
+			return false;
+		}
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if(std::chrono::duration<double>(now - this->last).count() < PROGRESS_INTERVAL) {
+			return false;
+		}
+		this->last = now;
+		return true;
+	}
+
+	void report(Game &best, double best_h, unsigned long iteration, size_t n_open, size_t n_states) {
+		snprintf(this->status, sizeof(this->status),
+		         "Iteration #%lu, %.1f s: %lu states, %lu open, best h = %f",
+		         iteration, this->seconds(), (unsigned long)n_states, (unsigned long)n_open, best_h);
+		this->renderer.draw(best, this->status);
+	}
+};
+
+#endif
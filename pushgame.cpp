@@ -0,0 +1,425 @@
+#include <cassert>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "game.cpp"
+#include "level.cpp"
+#include "deadlock.cpp"
+#include "corral.cpp"
+#include "trace.cpp"
+
+#ifndef PUSHGAME_H
+#define PUSHGAME_H
+
+/** *************************************************************************
+ * Push-Level Game Representation
+ * ************************************************************************** */
+
+/**
+ * Mark all fields the player can walk to from its current position without
+ * pushing a box. reach is indexed by row-major board index.
+ */
+void player_reach(Game &game, std::vector<bool> &reach) {
+	Board &board = game.board;
+	int n = board.dimensions.x * board.dimensions.y;
+	reach.assign(n, false);
+	std::vector<int> todo;
+	todo.push_back(board.get_index(game.player));
+	reach[todo.back()] = true;
+	while(!todo.empty()) {
+		int i = todo.back();
+		todo.pop_back();
+		Coord pos(i % board.dimensions.x, i / board.dimensions.x);
+		for(int a = 0; a < 4; a++) {
+			Coord next = pos + actions[a];
+			if(next.x < 0 || next.y < 0 || next.x >= board.dimensions.x
+			   || next.y >= board.dimensions.y) {
+				continue;
+			}
+			int j = board.get_index(next);
+			Board::Field field = board.fields[j];
+			if(reach[j] || (field != Board::empty && field != Board::goal)) {
+				continue;
+			}
+			reach[j] = true;
+			todo.push_back(j);
+		}
+	}
+}
+
+/**
+ * Find a shortest walk (no pushes) for the player to the given field. The
+ * walk is appended to path as action letters. Returns false if the field is
+ * not reachable.
+ */
+bool player_path(Game &game, Coord to, std::string &path) {
+	Board &board = game.board;
+	int n = board.dimensions.x * board.dimensions.y;
+	std::vector<int> via(n, -1); // Action taken to first reach each field
+	std::vector<int> todo;
+	int start = board.get_index(game.player);
+	int target = board.get_index(to);
+	via[start] = 4;
+	todo.push_back(start);
+	for(size_t k = 0; k < todo.size() && via[target] == -1; k++) {
+		int i = todo[k];
+		Coord pos(i % board.dimensions.x, i / board.dimensions.x);
+		for(int a = 0; a < 4; a++) {
+			Coord next = pos + actions[a];
+			if(next.x < 0 || next.y < 0 || next.x >= board.dimensions.x
+			   || next.y >= board.dimensions.y) {
+				continue;
+			}
+			int j = board.get_index(next);
+			Board::Field field = board.fields[j];
+			if(via[j] != -1 || (field != Board::empty && field != Board::goal)) {
+				continue;
+			}
+			via[j] = a;
+			todo.push_back(j);
+		}
+	}
+	if(via[target] == -1) {
+		return false;
+	}
+	std::string walk;
+	for(Coord pos = to; !(pos == game.player); pos = pos - actions[via[board.get_index(pos)]]) {
+		walk.push_back(action_char(actions[via[board.get_index(pos)]]));
+	}
+	path.append(walk.rbegin(), walk.rend());
+	return true;
+}
+
+/**
+ * In the push graph, a transition is a push of a box (and the walk of the
+ * player to it). The exact player position is irrelevant between pushes, only
+ * the area it can reach matters; the player is therefore normalized to the
+ * top-left-most reachable field, so that states which differ only by a walk
+ * compare equal.
+ *
+ * Each state remembers where the player stood to start the moves that
+ * produced it, and those moves, so that a push solution can later be expanded
+ * into single moves (see expand_push_solution). Usually this is a single
+ * push; if macros are enabled in the level analysis, a transition can also be
+ * a macro move that consists of many pushes:
+ *
+ * - Tunnel macro: a box pushed into a tunnel in which the player cannot get
+ *   past it is pushed all the way through.
+ * - Goal room macro: a box pushed onto the entrance of the goal room can also
+ *   be taken directly to the next free goal in the room's fill order. This
+ *   is an extra successor; the plain push stays, so optimality is kept.
+ */
+struct PushGame : Game {
+	Coord push_from;
+	std::string moves;
+	int n_pushes;
+
+	PushGame() {}
+
+	PushGame(Game &game) :
+		Game(game),
+		push_from(game.player),
+		n_pushes(0) {
+		this->normalize();
+	}
+
+	/**
+	 * Move the player to the canonical field of its reachable area.
+	 */
+	void normalize() {
+		std::vector<bool> reach;
+		player_reach(*this, reach);
+		for(size_t i = 0; i < reach.size(); i++) {
+			if(reach[i]) {
+				this->player = Coord(i % this->board.dimensions.x,
+				                     i / this->board.dimensions.x);
+				break;
+			}
+		}
+	}
+
+	/**
+	 * Give all legal and not obviously unsolvable pushes from current state.
+	 * If corral pruning is enabled and there is a PI-corral, only pushes of
+	 * its border boxes are given.
+	 */
+	void expand(std::vector<State *> &neighbors) {
+		std::vector<bool> reach;
+		std::vector<bool> movable;
+		player_reach(*this, reach);
+		bool corral = (this->level && this->level->corrals
+		               && find_pi_corral(*this, reach, movable));
+		int n = this->board.dimensions.x * this->board.dimensions.y;
+		for(int i = 0; i < n; i++) {
+			if(this->board.fields[i] != Board::box
+			   && this->board.fields[i] != Board::box_on_goal) {
+				continue;
+			}
+			if(corral && !movable[i]) {
+				search_stats.pruned_corral++;
+				continue;
+			}
+			Coord box(i % this->board.dimensions.x, i / this->board.dimensions.x);
+			for(int a = 0; a < 4; a++) {
+				Coord from = box - actions[a];
+				Coord to = box + actions[a];
+				if(from.x < 0 || from.y < 0 || to.x < 0 || to.y < 0
+				   || from.x >= this->board.dimensions.x
+				   || to.x >= this->board.dimensions.x
+				   || from.y >= this->board.dimensions.y
+				   || to.y >= this->board.dimensions.y) {
+					continue;
+				}
+				Board::Field target = this->board.get_field(to);
+				if(!reach[this->board.get_index(from)]
+				   || (target != Board::empty && target != Board::goal)) {
+					continue;
+				}
+				PushGame *neighbor = new PushGame(*this);
+				neighbor->player = from;
+				neighbor->push_from = from;
+				neighbor->moves = std::string(1, action_char(actions[a]));
+				neighbor->n_pushes = 1;
+				neighbor->take_action(actions[a]);
+				PushGame *macro = NULL;
+				Coord macro_to = to;
+				if(this->level && this->level->macros) {
+					to = neighbor->extend_macro(to, actions[a]);
+					// The goal room macro is offered next to the plain push,
+					// not instead of it, so that push-optimal solutions that
+					// arrange the room differently are not lost.
+					if(neighbor->on_goal_room_entrance(to)) {
+						macro = new PushGame(*neighbor);
+						macro_to = macro->goal_room_macro(to);
+						if(macro_to == to) {
+							delete[] macro->board.fields;
+							delete macro;
+							macro = NULL;
+						}
+					}
+				}
+				this->add_neighbor(neighbor, to, neighbors);
+				if(macro) {
+					this->add_neighbor(macro, macro_to, neighbors);
+				}
+			}
+		}
+	}
+
+	/**
+	 * Add neighbor, whose last pushed box ended up on field box, to
+	 * neighbors unless it is obviously unsolvable; deletes it otherwise.
+	 */
+	void add_neighbor(PushGame *neighbor, Coord box, std::vector<State *> &neighbors) {
+		if(neighbor->is_obviously_unsolvable()) {
+			search_stats.pruned_corner++;
+			delete[] neighbor->board.fields;
+			delete neighbor;
+			return;
+		}
+		if(this->level && is_pattern_deadlock(this->level, *neighbor, box)) {
+			search_stats.pruned_pattern++;
+			delete[] neighbor->board.fields;
+			delete neighbor;
+			return;
+		}
+		neighbor->normalize();
+		neighbors.push_back(static_cast<State *>(neighbor));
+	}
+
+	/**
+	 * Apply a move and record it.
+	 */
+	void macro_step(char move) {
+		if(this->take_action(char_action(move))) {
+			this->n_pushes++;
+		}
+		this->moves.push_back(move);
+	}
+
+	/**
+	 * Called after the box now on field box was pushed along action; turns
+	 * the push into a macro move if it entered a tunnel. Returns the field
+	 * the box ends up on.
+	 */
+	Coord extend_macro(Coord box, Coord action) {
+		Level *level = this->level;
+		while(true) {
+			Coord next = box + action;
+			if(!level->in_bounds(next)
+			   || this->board.get_field(box) != Board::box
+			   || !level->is_tunnel(level->index(box), action)
+			   || !level->is_tunnel(level->index(this->player), action)) {
+				break;
+			}
+			Board::Field target = this->board.get_field(next);
+			if(target != Board::empty && target != Board::goal) {
+				break;
+			}
+			this->macro_step(action_char(action));
+			box = next;
+		}
+		return box;
+	}
+
+	/**
+	 * Whether the box on field box was just pushed onto the goal room
+	 * entrance from outside of the room.
+	 */
+	bool on_goal_room_entrance(Coord box) {
+		Level *level = this->level;
+		return level->index(box) == level->goal_room_entrance
+		       && !level->goal_room[level->index(this->player)];
+	}
+
+	/**
+	 * Take the box on the goal room entrance to the first free goal in fill
+	 * order, using a breadth-first search over (box, player) positions in
+	 * which all other boxes stay put. Leaves the state unchanged if that
+	 * goal cannot be reached. Returns the field the box ends up on.
+	 */
+	Coord goal_room_macro(Coord box) {
+		Level *level = this->level;
+		int target = -1;
+		for(size_t k = 0; k < level->goal_room_order.size(); k++) {
+			if(this->board.fields[level->goal_room_order[k]] == Board::goal) {
+				target = level->goal_room_order[k];
+				break;
+			}
+		}
+		if(target == -1) {
+			return box;
+		}
+		// The player may move within the room, on the entrance, and on
+		// the fields right outside of it.
+		int n = level->dimensions.x * level->dimensions.y;
+		int entrance = level->goal_room_entrance;
+		std::vector<bool> allowed(level->goal_room);
+		allowed[entrance] = true;
+		for(int a = 0; a < 4; a++) {
+			Coord next = level->coord(entrance) + actions[a];
+			if(level->in_bounds(next)) {
+				allowed[level->index(next)] = true;
+			}
+		}
+		typedef long long Key; // box * n + player
+		std::unordered_map<Key, std::pair<Key, char> > via;
+		std::vector<Key> todo;
+		int origin = level->index(box);
+		Key start = (Key)origin * n + level->index(this->player);
+		Key found = -1;
+		via[start] = std::make_pair(start, 0);
+		todo.push_back(start);
+		for(size_t k = 0; k < todo.size() && found == -1; k++) {
+			int b = todo[k] / n;
+			Coord player = level->coord(todo[k] % n);
+			for(int a = 0; a < 4 && found == -1; a++) {
+				Coord next = player + actions[a];
+				if(!level->in_bounds(next) || !allowed[level->index(next)]) {
+					continue;
+				}
+				int nb = b;
+				int entered = level->index(next);
+				if(entered == b) {
+					Coord pushed = next + actions[a];
+					if(!level->in_bounds(pushed) || !level->goal_room[level->index(pushed)]) {
+						continue;
+					}
+					nb = level->index(pushed);
+					entered = nb;
+				}
+				// The field the box started on is free once it has moved.
+				Board::Field field = this->board.fields[entered];
+				if(entered != origin && field != Board::empty && field != Board::goal) {
+					continue;
+				}
+				Key key = (Key)nb * n + level->index(next);
+				if(via.count(key)) {
+					continue;
+				}
+				via[key] = std::make_pair(todo[k], action_char(actions[a]));
+				todo.push_back(key);
+				if(nb == target) {
+					found = key;
+				}
+			}
+		}
+		if(found == -1) {
+			return box;
+		}
+		std::string path;
+		for(Key key = found; key != start; key = via[key].first) {
+			path.push_back(via[key].second);
+		}
+		for(std::string::reverse_iterator it = path.rbegin(); it != path.rend(); ++it) {
+			this->macro_step(*it);
+		}
+		return level->coord(target);
+	}
+
+	Game *copy() {
+		return new PushGame(*this);
+	}
+
+	size_t footprint() {
+		return Game::footprint() - sizeof(Game) + sizeof(PushGame)
+		       + this->moves.capacity();
+	}
+
+	/**
+	 * The walk to the box is not part of the state, so only the moves of
+	 * the transition itself are counted.
+	 */
+	int edge_moves(Game &parent) {
+		return this->moves.size();
+	}
+
+	int edge_pushes(Game &parent) {
+		return this->n_pushes;
+	}
+
+};
+
+/**
+ * Turn a solution in the push graph into a sequence of single-move game
+ * states starting from start, by inserting the player's walks between pushes.
+ *
+ * The transition between two consecutive states is recovered by generating
+ * the successors of the first one again: the moves stored in a state found
+ * by the search describe how it was reached first, which need not be the
+ * transition on the solution path.
+ */
+std::vector<State *> expand_push_solution(Game &start, std::vector<State *> &solution) {
+	TRACE_SPAN("expand pushes");
+	std::vector<State *> out;
+	if(solution.empty()) {
+		return out;
+	}
+	Game *current = new Game(start);
+	out.push_back(current);
+	for(size_t i = 1; i < solution.size(); i++) {
+		PushGame *prev = static_cast<PushGame *>(solution[i-1]);
+		std::vector<State *> neighbors = prev->get_neighbors();
+		std::string moves;
+		for(size_t k = 0; k < neighbors.size(); k++) {
+			PushGame *step = static_cast<PushGame *>(neighbors[k]);
+			if(moves.empty() && *step == *solution[i]) {
+				bool found = player_path(*current, step->push_from, moves);
+				assert(found);
+				moves += step->moves;
+			}
+			delete[] step->board.fields;
+			delete step;
+		}
+		assert(!moves.empty());
+		for(size_t j = 0; j < moves.size(); j++) {
+			Game *next = new Game(*current);
+			next->take_action(char_action(moves[j]));
+			out.push_back(next);
+			current = next;
+		}
+	}
+	return out;
+}
+
+#endif
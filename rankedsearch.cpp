@@ -0,0 +1,557 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <chrono>
+#include "game.cpp"
+#include "search.cpp"
+#include "pack.cpp"
+#include "pushgame.cpp"
+#include "cost.cpp"
+#include "progress.cpp"
+#include "trace.cpp"
+
+#ifndef RANKEDSEARCH_H
+#define RANKEDSEARCH_H
+
+/** *************************************************************************
+ * Ranked A* Search
+ * ************************************************************************** */
+
+/**
+ * Largest table of ranked states (two bytes per rank) a search is allowed to
+ * use; A* falls back to hashing states if the level needs more. Can be set
+ * at compile time, 0 disabling ranked search altogether.
+ */
+#ifndef RANKED_MAX_BYTES
+#define RANKED_MAX_BYTES ((size_t)256 << 20)
+#endif
+
+#define RANK_NONE (~0ULL)
+
+/**
+ * Binomial coefficients are saturated at this value; a state space that
+ * large is never ranked anyway.
+ */
+#define RANK_SATURATED (1ULL << 62)
+
+/**
+ * Perfect hash of the states of a level: a bijection between the states and
+ * the integers from 0 to size - 1, without collisions and without a table.
+ *
+ * Boxes can only ever be on live cells, those from which a box could still
+ * be pushed to a goal if the board were otherwise empty. The set of box
+ * cells is ranked among all subsets of the live cells of the same size in
+ * colexicographic order: for live cells c_1 < ... < c_k (numbered from 0),
+ * the rank is C(c_1, 1) + ... + C(c_k, k). The player is ranked among the
+ * cells without a box. In the push graph, the player is normalized to the
+ * first cell of its region, so its rank stands for the region.
+ *
+ * A state with a box on a dead cell has no rank; it cannot be solved.
+ */
+struct StateRanker {
+	StatePacker packer; // Static board (packer.base) and cell numbering
+	int n_boxes;
+	int n_free;                       // Cells not holding a box
+	std::vector<int> live;            // Live number of each cell, -1 if dead
+	std::vector<int> live_cells;      // Cell of each live number
+	std::vector<unsigned long long> binomial; // C(n, k) at n * (n_boxes + 1) + k
+	unsigned long long size;          // Number of ranks, 0 if too many to count
+
+	StateRanker(Game &start) : packer(start), n_boxes(0), size(0) {
+		CellIndex &cells = this->packer.cells;
+		for(int c = 0; c < cells.n_cells; c++) {
+			Board::Field field = start.board.fields[cells.field[c]];
+			if(field == Board::box || field == Board::box_on_goal) {
+				this->n_boxes++;
+			}
+		}
+		this->n_free = cells.n_cells - this->n_boxes;
+
+		// Pull boxes away from the goals: a box on c can be pushed along
+		// action a onto a live cell if the player can stand behind it.
+		std::vector<bool> is_live(cells.n_cells, false);
+		std::vector<int> todo;
+		for(int c = 0; c < cells.n_cells; c++) {
+			if(this->packer.base.fields[cells.field[c]] == Board::goal) {
+				is_live[c] = true;
+				todo.push_back(c);
+			}
+		}
+		while(!todo.empty()) {
+			int to = todo.back();
+			todo.pop_back();
+			for(int a = 0; a < 4; a++) {
+				int back = a ^ 1; // actions come in opposite pairs
+				int from = cells.neighbors[4 * to + back];
+				int stand = (from == -1 ? -1 : cells.neighbors[4 * from + back]);
+				if(stand != -1 && !is_live[from]) {
+					is_live[from] = true;
+					todo.push_back(from);
+				}
+			}
+		}
+		this->live.assign(cells.n_cells, -1);
+		for(int c = 0; c < cells.n_cells; c++) {
+			if(is_live[c]) {
+				this->live[c] = this->live_cells.size();
+				this->live_cells.push_back(c);
+			}
+		}
+
+		int n_live = this->live_cells.size();
+		int k_max = this->n_boxes;
+		this->binomial.assign((n_live + 1) * (k_max + 1), 0);
+		for(int n = 0; n <= n_live; n++) {
+			this->binomial[n * (k_max + 1)] = 1;
+			for(int k = 1; k <= std::min(n, k_max); k++) {
+				unsigned long long c = this->choose(n - 1, k - 1) + (k < n ? this->choose(n - 1, k) : 0);
+				this->binomial[n * (k_max + 1) + k] = std::min(c, RANK_SATURATED);
+			}
+		}
+		unsigned long long box_sets = this->choose(n_live, k_max);
+		if(this->n_free > 0 && box_sets < RANK_SATURATED
+		   && box_sets <= RANK_SATURATED / this->n_free && this->rank(start) != RANK_NONE) {
+			this->size = box_sets * this->n_free;
+		}
+	}
+
+	unsigned long long choose(int n, int k) {
+		return this->binomial[n * (this->n_boxes + 1) + k];
+	}
+
+	unsigned long long rank(Game &state) {
+		CellIndex &cells = this->packer.cells;
+		int player = cells.cell[state.board.get_index(state.player)];
+		unsigned long long boxes = 0;
+		int k = 0;
+		int below = 0; // Boxes on cells before the player's
+		for(int c = 0; c < cells.n_cells; c++) {
+			Board::Field field = state.board.fields[cells.field[c]];
+			if(field != Board::box && field != Board::box_on_goal) {
+				continue;
+			}
+			if(this->live[c] == -1 || k == this->n_boxes) {
+				return RANK_NONE;
+			}
+			k++;
+			boxes += this->choose(this->live[c], k);
+			below += (c < player);
+		}
+		return boxes * this->n_free + (player - below);
+	}
+
+	/**
+	 * Overwrite player and boxes of state (a board of the level's
+	 * dimensions) with the state of the given rank.
+	 */
+	void unrank(unsigned long long rank, Game &state) {
+		CellIndex &cells = this->packer.cells;
+		memcpy(state.board.fields, this->packer.base.fields,
+		       sizeof(Board::Field) * this->packer.n_fields);
+		unsigned long long boxes = rank / this->n_free;
+		int player = rank % this->n_free;
+		int n = this->live_cells.size();
+		for(int k = this->n_boxes; k >= 1; k--) {
+			do {
+				n--;
+			} while(this->choose(n, k) > boxes);
+			boxes -= this->choose(n, k);
+			int i = cells.field[this->live_cells[n]];
+			state.board.fields[i] = (state.board.fields[i] == Board::goal ? Board::box_on_goal
+			                                                               : Board::box);
+		}
+		for(int c = 0; c < cells.n_cells; c++) {
+			Board::Field field = state.board.fields[cells.field[c]];
+			if(field != Board::box && field != Board::box_on_goal && player-- == 0) {
+				state.player = Coord(cells.field[c] % state.board.dimensions.x,
+				                     cells.field[c] / state.board.dimensions.x);
+				break;
+			}
+		}
+	}
+};
+
+/**
+ * Whether the player (or a box) could stand on pos: on the board and neither
+ * a wall nor a box.
+ */
+bool ranked_is_free(Game &state, Coord pos) {
+	if(pos.x < 0 || pos.y < 0 || pos.x >= state.board.dimensions.x
+	   || pos.y >= state.board.dimensions.y) {
+		return false;
+	}
+	Board::Field field = state.board.get_field(pos);
+	return field == Board::empty || field == Board::goal;
+}
+
+/**
+ * Move the box on from to the (free) field to.
+ */
+void ranked_move_box(Game &state, Coord from, Coord to) {
+	Board::Field field = state.board.get_field(from);
+	state.board.set_field(from, field == Board::box_on_goal ? Board::goal : Board::empty);
+	field = state.board.get_field(to);
+	state.board.set_field(to, field == Board::goal ? Board::box_on_goal : Board::box);
+}
+
+/**
+ * All states from which a single move could have led to state: the player
+ * stepped back, alone or pulling the box in front of it.
+ */
+void ranked_predecessors(Game &state, std::vector<Game *> &out) {
+	for(int a = 0; a < 4; a++) {
+		Coord from = state.player - actions[a];
+		if(!ranked_is_free(state, from)) {
+			continue;
+		}
+		Game *walk = new Game(state);
+		walk->player = from;
+		out.push_back(walk);
+		Coord box = state.player + actions[a];
+		if(box.x < 0 || box.y < 0 || box.x >= state.board.dimensions.x
+		   || box.y >= state.board.dimensions.y) {
+			continue;
+		}
+		Board::Field field = state.board.get_field(box);
+		if(field == Board::box || field == Board::box_on_goal) {
+			Game *pull = new Game(state);
+			ranked_move_box(*pull, box, state.player);
+			pull->player = from;
+			out.push_back(pull);
+		}
+	}
+}
+
+/**
+ * All states from which a single push could have led to state: a box pulled
+ * back by one field towards a player who can get there.
+ */
+void ranked_predecessors(PushGame &state, std::vector<PushGame *> &out) {
+	std::vector<bool> reach;
+	player_reach(state, reach);
+	int n = state.board.dimensions.x * state.board.dimensions.y;
+	for(int i = 0; i < n; i++) {
+		if(state.board.fields[i] != Board::box && state.board.fields[i] != Board::box_on_goal) {
+			continue;
+		}
+		Coord box(i % state.board.dimensions.x, i / state.board.dimensions.x);
+		for(int a = 0; a < 4; a++) {
+			Coord from = box - actions[a];
+			Coord stand = from - actions[a];
+			if(!ranked_is_free(state, from) || !reach[state.board.get_index(from)]
+			   || !ranked_is_free(state, stand)) {
+				continue;
+			}
+			PushGame *pull = new PushGame(state);
+			ranked_move_box(*pull, box, from);
+			pull->player = stand;
+			pull->normalize();
+			out.push_back(pull);
+		}
+	}
+}
+
+/**
+ * Whether a ranked search minimizes the cost model's objective: every
+ * transition must cost the same in it, so that g is a small integer that
+ * only grows along a path.
+ */
+bool ranked_supports(Game &start, CostModel *cost) {
+	return !cost || dynamic_cast<MoveCost *>(cost);
+}
+
+bool ranked_supports(PushGame &start, CostModel *cost) {
+	// Macro moves would need predecessors several pushes back.
+	return dynamic_cast<PushCost *>(cost) && !(start.level && start.level->macros);
+}
+
+/**
+ * Open list entry; among entries with equal f, the deeper state comes
+ * first.
+ */
+struct RankedEntry {
+	unsigned int f;
+	unsigned int g;
+	unsigned long long rank;
+
+	RankedEntry(unsigned int f, unsigned int g, unsigned long long rank) :
+		f(f), g(g), rank(rank) {}
+
+	bool operator<(const RankedEntry &other) const {
+		if(this->f != other.f) {
+			return this->f > other.f;
+		}
+		return this->g < other.g;
+	}
+};
+
+/**
+ * Table entries: 0 for a state not seen yet, otherwise g + 1 in the lower
+ * 15 bits and RANKED_CLOSED once the state has been expanded with that g.
+ */
+#define RANKED_CLOSED 0x8000
+#define RANKED_MAX_G  (RANKED_CLOSED - 2)
+
+/**
+ * A* over ranked states (see StateRanker). What A_star keeps in hash tables
+ * per state, the state itself, its g-value and its predecessor, comes down
+ * to two bytes at the state's rank in a flat table: nothing is hashed, no
+ * states are compared, and the table never grows. States are rebuilt from
+ * their rank when expanded, and the open list holds ranks only. The path is
+ * recovered backwards from the goal: of the states a single step before it,
+ * one with a lower g that leads to it must have been its predecessor.
+ *
+ * The table is allocated with calloc, so that the operating system hands
+ * out its (zeroed) pages only once they are written; a search touching few
+ * states uses little memory even in a large table.
+ *
+ * Transitions must all cost the same (see ranked_supports).
+ */
+template<typename StateT, typename HeuristicT>
+struct RankedSearch {
+	StateRanker &ranker;
+	HeuristicT &heuristic;
+	CostModel *cost;
+	bool verbose;
+	SearchLimits *limits;
+	unsigned short *table;
+	std::priority_queue<RankedEntry> todo;
+	bool overflow; // A g-value did not fit into the table
+
+	RankedSearch(StateRanker &ranker, HeuristicT &heuristic, CostModel *cost, bool verbose,
+	             SearchLimits *limits) :
+		ranker(ranker), heuristic(heuristic), cost(cost), verbose(verbose), limits(limits),
+		table(NULL), overflow(false) {}
+
+	~RankedSearch() {
+		free(this->table);
+	}
+
+	size_t memory() {
+		return this->ranker.size * sizeof(unsigned short)
+		       + this->todo.size() * sizeof(RankedEntry);
+	}
+
+	/**
+	 * Whether start leads to the (different) state to in a single step.
+	 */
+	bool leads_to(StateT &start, StateT &to, std::vector<State *> &neighbors) {
+		neighbors.clear();
+		start.StateT::expand(neighbors);
+		bool found = false;
+		for(size_t i = 0; i < neighbors.size(); i++) {
+			found = found || *static_cast<StateT *>(neighbors[i]) == to;
+			delete_state(neighbors[i]);
+		}
+		return found;
+	}
+
+	/**
+	 * The states from start to goal, start itself first.
+	 */
+	std::vector<State *> path(StateT &start, StateT &goal) {
+		SearchStats counted = search_stats; // Not part of the search
+		std::vector<State *> out;
+		std::vector<StateT *> before;
+		std::vector<State *> neighbors;
+		StateT *current = new StateT(goal);
+		unsigned int g = this->table[this->ranker.rank(*current)] & ~RANKED_CLOSED;
+		while(g > 1) {
+			out.push_back(current);
+			before.clear();
+			ranked_predecessors(*current, before);
+			StateT *previous = NULL;
+			for(size_t i = 0; i < before.size(); i++) {
+				unsigned long long rank = this->ranker.rank(*before[i]);
+				unsigned int seen = (rank == RANK_NONE ? 0 : this->table[rank] & ~RANKED_CLOSED);
+				if(!previous && seen && seen < g && this->leads_to(*before[i], *current, neighbors)) {
+					previous = before[i];
+					g = seen;
+				} else {
+					delete_state(before[i]);
+				}
+			}
+			assert(previous);
+			current = previous;
+		}
+		delete_state(current);
+		out.push_back(&start);
+		std::reverse(out.begin(), out.end());
+		search_stats = counted;
+		return out;
+	}
+
+	std::vector<State *> run(StateT &start) {
+		SearchLimits *limits = this->limits;
+		std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+		this->table = static_cast<unsigned short *>(calloc(this->ranker.size, sizeof(unsigned short)));
+		if(!this->table) {
+			this->overflow = true;
+			return std::vector<State *>();
+		}
+		StateT state(start);
+		StateT shown(start);
+		std::vector<State *> neighbors;
+		unsigned long long start_rank = this->ranker.rank(start);
+		double best = evaluate(this->heuristic, start);
+		unsigned long long best_rank = start_rank;
+		this->table[start_rank] = 1;
+		if(best != INFINITY) {
+			this->todo.push(RankedEntry(this->cost->estimate(best), 0, start_rank));
+		}
+		unsigned long iteration = 0;
+		unsigned long n_states = 1;
+		SearchProgress *reporter = (this->verbose ? new SearchProgress(stderr) : NULL);
+		bool found = false;
+
+		while(!this->todo.empty()) {
+			iteration++;
+			if(reporter && reporter->due(iteration)) {
+				this->ranker.unrank(best_rank, shown);
+				reporter->report(shown, best, iteration, this->todo.size(), n_states);
+			}
+			size_t memory = this->memory();
+			search_stats.bytes_stored = memory;
+			if(limits && limits->max_memory && memory > limits->max_memory) {
+				limits->out_of_memory = true;
+				break;
+			}
+			if(limits && limits->out_of_time()) {
+				limits->timed_out = true;
+				break;
+			}
+			if(limits && limits->cancel && *limits->cancel) {
+				limits->cancelled = true;
+				break;
+			}
+			if(limits && limits->progress && iteration % SEARCH_PROGRESS_EVERY == 0
+			   && !limits->progress(limits->progress_data, iteration,
+			           std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count())) {
+				limits->cancelled = true;
+				break;
+			}
+			search_stats.open_peak = std::max(search_stats.open_peak, (unsigned long)this->todo.size());
+			RankedEntry entry = this->todo.top();
+			this->todo.pop();
+			unsigned short &seen = this->table[entry.rank];
+			if((seen & RANKED_CLOSED) || seen != entry.g + 1) {
+				continue; // Expanded, or queued again with a lower g, since
+			}
+			seen |= RANKED_CLOSED;
+			this->ranker.unrank(entry.rank, state);
+			if(state.StateT::is_goal()) {
+				found = true;
+				break;
+			}
+			search_stats.expanded++;
+			neighbors.clear();
+			state.StateT::expand(neighbors);
+			search_stats.generated += neighbors.size();
+			for(std::vector<State *>::iterator it = neighbors.begin(); it != neighbors.end(); ++it) {
+				StateT *successor = static_cast<StateT *>(*it);
+				unsigned long long rank = this->ranker.rank(*successor);
+				unsigned int g = entry.g + this->cost->step(state, *successor);
+				if(rank == RANK_NONE) {
+					// A box on a dead cell, which the heuristic would
+					// find unsolvable as well.
+					search_stats.pruned_heuristic++;
+					delete_state(successor);
+					continue;
+				}
+				if(g > RANKED_MAX_G) {
+					this->overflow = true;
+					for(; it != neighbors.end(); ++it) {
+						delete_state(*it);
+					}
+					break;
+				}
+				unsigned short &old = this->table[rank];
+				if(old) {
+					search_stats.duplicates++;
+					if(g + 1 >= (unsigned int)(old & ~RANKED_CLOSED)) {
+						delete_state(successor);
+						continue;
+					}
+					search_stats.reopened++;
+				} else {
+					n_states++;
+				}
+				double h = evaluate(this->heuristic, *successor);
+				if(h == INFINITY) {
+					search_stats.pruned_heuristic++;
+					old = (g + 1) | RANKED_CLOSED; // Kept to recognize it again
+				} else {
+					old = g + 1;
+					if(h <= best) {
+						best = h;
+						best_rank = rank;
+					}
+					this->todo.push(RankedEntry(g + this->cost->estimate(h), g, rank));
+				}
+				delete_state(successor);
+			}
+			if(this->overflow) {
+				break;
+			}
+		}
+
+		if(limits) {
+			limits->n_expanded = iteration;
+		}
+		if(reporter) {
+			this->ranker.unrank(found ? this->ranker.rank(state) : best_rank, shown);
+			reporter->report(shown, best, iteration, this->todo.size(), n_states);
+			delete reporter;
+		}
+		if(!found || this->overflow) {
+			return std::vector<State *>();
+		}
+		TRACE_SPAN("reconstruct path");
+		return this->path(start, state);
+	}
+};
+
+/**
+ * A* search over ranked states (see RankedSearch), if the level and the
+ * search allow it: the objective must be supported (ranked_supports), and
+ * the table must fit into RANKED_MAX_BYTES and the memory limit. Returns
+ * false, without a result, if they do not; the caller then searches with
+ * A_star. Otherwise, the result is that of A_star.
+ */
+template<typename StateT, typename HeuristicT>
+bool ranked_A_star(StateT &start, HeuristicT &heuristic, bool verbose, CostModel *cost,
+                   SearchLimits *limits, std::vector<State *> *solution) {
+	if(!RANKED_MAX_BYTES || !ranked_supports(start, cost)) {
+		return false;
+	}
+	StateRanker ranker(start);
+	size_t max_bytes = RANKED_MAX_BYTES;
+	if(limits && limits->max_memory) {
+		max_bytes = std::min(max_bytes, limits->max_memory);
+	}
+	if(!ranker.size || ranker.size > max_bytes / sizeof(unsigned short)) {
+		return false;
+	}
+	if(verbose) {
+		fprintf(stderr, "Ranked search: %llu states (%d boxes on %lu live cells), %.1f MB table.\n",
+		        ranker.size, ranker.n_boxes, (unsigned long)ranker.live_cells.size(),
+		        ranker.size * sizeof(unsigned short) / 1048576.0);
+	}
+	MoveCost move_cost;
+	RankedSearch<StateT, HeuristicT> search(ranker, heuristic, (cost ? cost : &move_cost), verbose,
+	                                        limits);
+	TRACE_SPAN("ranked search");
+	*solution = search.run(start);
+	if(search.overflow) {
+		search_stats.reset(search_stats.timing);
+		return false;
+	}
+	return true;
+}
+
+#endif
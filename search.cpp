@@ -5,8 +5,15 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <functional>
+#include <queue>
+#include <chrono>
+#include <atomic>
 #include <boost/heap/fibonacci_heap.hpp>
 #include "io.cpp"
+#include "cost.cpp"
+#include "checkpoint.cpp"
+#include "progress.cpp"
+#include "trace.cpp"
 
 #ifndef SEARCH_H
 #define SEARCH_H
@@ -14,28 +21,32 @@
 
 struct Action {};
 
-template<>
-struct std::hash<State> {
-	size_t operator()(const State& s) const {
-		return s.hash();
-	}
-};
-
-template<>
-struct std::hash<Game> {
-	size_t operator()(const State& s) const {
-		return s.hash();
-	}
-};
-
 struct Heuristic {
+	virtual ~Heuristic() {}
 	virtual double operator()(State &state) = 0;
 };
 
+/**
+ * Evaluate the heuristic for state, counting (and, if enabled, timing) the
+ * call in search_stats.
+ */
+template<typename HeuristicT>
+double evaluate(HeuristicT &heuristic, State &state) {
+	search_stats.heuristic_calls++;
+	if(!search_stats.timing) {
+		return heuristic(state);
+	}
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	double h = heuristic(state);
+	search_stats.heuristic_seconds += std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - started).count();
+	return h;
+}
+
 struct PrioritizedState {
-	double priority;
+	Cost priority;
 	State *state;
-	PrioritizedState(double priority, State *state) :
+	PrioritizedState(Cost priority, State *state) :
 	priority(priority), state(state) {
 	}
 	bool operator<(const PrioritizedState &other) const {
@@ -54,13 +65,12 @@ template<typename T>
 struct PointerSet {
 	std::unordered_map<size_t, std::vector<T *> > data;
 	PointerSet() : data() {}
-	size_t count(T obj) {
+	size_t count(const T &obj) {
 		return (this->find(obj) == NULL ? 0 : 1);
 	}
 
 	void insert(T *obj) {
-		std::hash<T> hasher;
-		size_t h = hasher(*obj); // Hash is calculated on dereferenced value
+		size_t h = obj->hash(); // Hash is calculated on dereferenced value
 		if(this->count(*static_cast<Game *>(obj))) {
 			return;
 		}
@@ -73,9 +83,8 @@ struct PointerSet {
 		}
 	}
 
-	T *find(T obj) {
-		std::hash<T> hasher;
-		size_t h = hasher(obj); // Hash is calculatedon  dereferenced value
+	T *find(const T &obj) {
+		size_t h = obj.hash(); // Hash is calculatedon  dereferenced value
 		if(!this->data.count(h)) {
 			return NULL;
 		}
@@ -86,63 +95,298 @@ struct PointerSet {
 		}
 		return NULL;
 	}
+
+	/**
+	 * Insert obj unless an equal object is stored already; return the stored
+	 * one.
+	 */
+	T *intern(T *obj) {
+		this->insert(obj);
+		return this->find(*obj);
+	}
+
+	template<typename F>
+	void for_each(F f) {
+		for(typename std::unordered_map<size_t, std::vector<T *> >::iterator it = this->data.begin();
+		    it != this->data.end(); ++it) {
+			for(size_t i = 0; i < it->second.size(); i++) {
+				f(it->second[i]);
+			}
+		}
+	}
+};
+
+/**
+ * Hash and equality on the states pointed to, for hash tables keyed by state
+ * pointers.
+ */
+struct StatePointerHash {
+	size_t operator()(const State *state) const {
+		return state->hash();
+	}
+};
+
+struct StatePointerEqual {
+	bool operator()(const State *a, const State *b) const {
+		return *a == *b;
+	}
+};
+
+/**
+ * Rough number of bytes A* needs per stored state besides the state itself:
+ * entries in the visited set, g and predecessor tables, and the open list.
+ */
+#define A_STAR_STATE_OVERHEAD (16 * sizeof(void *))
+
+#define SEARCH_PROGRESS_EVERY 1024
+
+/**
+ * Optional limits on a single search. A search that exceeds one of them
+ * gives up, sets the corresponding flag and returns no solution. The number
+ * of expanded states is reported back in any case.
+ *
+ * The time limit counts from when the limits are created (or started is
+ * reset), so that whatever the caller does before the search, such as
+ * analyzing the level and setting up the heuristic, is included.
+ */
+struct SearchLimits {
+	double max_seconds; // 0 for no limit
+	std::chrono::steady_clock::time_point started;
+	size_t max_memory;  // Bytes of stored states, 0 for no limit
+	const std::atomic<bool> *cancel; // Set from another thread to give up, or NULL
+
+	/**
+	 * Called every SEARCH_PROGRESS_EVERY expansions, if set, with the number
+	 * of expansions and seconds so far; the search gives up (as if cancelled)
+	 * when it returns false.
+	 */
+	bool (*progress)(void *data, unsigned long n_expanded, double seconds);
+	void *progress_data;
+
+	unsigned long n_expanded;
+	bool timed_out;
+	bool out_of_memory;
+	bool cancelled;
+
+	SearchLimits() : max_seconds(0), started(std::chrono::steady_clock::now()), max_memory(0),
+		cancel(NULL), progress(NULL), progress_data(NULL), n_expanded(0), timed_out(false),
+		out_of_memory(false), cancelled(false) {}
+
+	/**
+	 * Whether the time limit has passed.
+	 */
+	bool out_of_time() const {
+		return this->max_seconds
+		       && std::chrono::duration<double>(std::chrono::steady_clock::now() - this->started).count()
+		          > this->max_seconds;
+	}
 };
 
+/**
+ * The open list A* uses unless told otherwise at compile time, e.g. with
+ * -DA_STAR_OPEN_LIST='std::priority_queue<PrioritizedState>'. Any type with
+ * push, top, pop, empty and size on PrioritizedState will do.
+ */
+#ifndef A_STAR_OPEN_LIST
+#define A_STAR_OPEN_LIST boost::heap::fibonacci_heap<PrioritizedState>
+#endif
+
+typedef A_STAR_OPEN_LIST AStarOpenList;
+
 /**
  * A* search. Returns an array of actions to take, starting from initial state
  * to reach a goal state.
- * 
- * The implementation currently assumes that the State given is actually a
- * Sokoban state, i.e. of type "Game". With some modifications, it should be
- * easy to make it work with arbitrary game states.
+ *
+ * The search is a template over its policies, so that everything on the
+ * path of an expansion can be inlined:
+ *
+ * - StateT: the type of all states of the search (Game or PushGame). Its
+ *   methods are called non-virtually, so it must be the exact type.
+ * - HeuristicT: the heuristic; calls are resolved at compile time if the
+ *   class is final.
+ * - OpenListT: priority queue of PrioritizedState (see AStarOpenList).
+ * - ClosedSetT: set of visited states, given empty; a PointerSet<Game> or a
+ *   PackedStateSet specialized on the size class of the level.
+ *
+ * The non-template A_star in dispatch.cpp picks the instance that fits a
+ * search's start state and heuristic.
+ *
+ * The objective is given by the cost model; by default, the number of moves
+ * is minimized.
+ *
+ * If a checkpoint is given, the search logs its progress to it, and continues
+ * from the restored state if the checkpoint was opened for resuming.
+ *
+ * With partial set, the search does partial expansion (PEA*): of the
+ * successors of a state taken off the open list with priority F, only those
+ * with f <= F are stored and queued. The others are freed, and the state goes
+ * back onto the open list with the lowest f among them, to generate them
+ * again when the search gets there. Most successors of a state are never
+ * taken off the open list, so this keeps far fewer states in memory, at the
+ * cost of generating (and evaluating) successors more than once. A state is
+ * logged to the checkpoint as expanded only once it is expanded completely.
+ *
+ * All states generated by the search except for those on the returned path
+ * are freed before returning.
  */
-std::vector<State *> A_star(State &start, Heuristic &heuristic, bool verbose = true) {
-
-	boost::heap::fibonacci_heap<PrioritizedState> todo;  // Nodes to be visited
-	PointerSet<Game> visited; // Set of all visited nodes
+template<typename StateT, typename HeuristicT, typename OpenListT, typename ClosedSetT>
+std::vector<State *> A_star(StateT &start, HeuristicT &heuristic, ClosedSetT &visited,
+                            bool verbose, CostModel *cost, Checkpoint *checkpoint,
+                            SearchLimits *limits, bool partial) {
+	OpenListT todo;  // Nodes to be visited
 	std::unordered_map<State *, State *> predecessor;  // Predecessor on shortest path to given state
-	std::unordered_map<State *, double> g; // g: Cost of shortest path to State
+	std::unordered_map<State *, Cost> g; // g: Cost of shortest path to State
+	std::vector<State *> neighbors; // Successors of the state being expanded
 	State *goal = NULL;
 	unsigned long iteration = 0;
+	size_t memory = 0;
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	MoveCost move_cost;
+	if(!cost) {
+		cost = &move_cost;
+	}
 
 	g[&start] = 0;
-	todo.push(PrioritizedState(heuristic(start), &start));
+	if(checkpoint && checkpoint->resumed) {
+		for(size_t i = 0; i < checkpoint->states.size(); i++) {
+			State *state = checkpoint->states[i];
+			if(i > 0) {
+				visited.intern(static_cast<Game *>(state));
+				predecessor[state] = checkpoint->states[checkpoint->parents[i]];
+				g[state] = checkpoint->costs[i];
+			}
+			if(checkpoint->open_states[i]) {
+				Cost f = g[state] + cost->estimate(evaluate(heuristic, *state));
+				todo.push(PrioritizedState(f, state));
+			}
+		}
+		iteration = checkpoint->iteration;
+		if(verbose) {
+			fprintf(stderr, "Resumed at iteration #%lu with %lu states, %lu open.\n",
+			        iteration, checkpoint->states.size(), todo.size());
+		}
+		checkpoint->states.clear();
+		checkpoint->parents.clear();
+		checkpoint->costs.clear();
+		checkpoint->open_states.clear();
+	} else {
+		todo.push(PrioritizedState(cost->estimate(evaluate(heuristic, start)), &start));
+	}
 	double best = +INFINITY;
+	State *best_state = &start;
+	SearchProgress *reporter = (verbose ? new SearchProgress(stderr) : NULL);
 
 	while(!todo.empty()) {
 		iteration++;
+		if(reporter && reporter->due(iteration)) {
+			reporter->report(*static_cast<Game *>(best_state), best, iteration, todo.size(), g.size());
+		}
+		if(checkpoint) {
+			checkpoint->tick(iteration);
+		}
+		if(limits && limits->max_memory && memory > limits->max_memory) {
+			limits->out_of_memory = true;
+			break;
+		}
+		if(limits && limits->out_of_time()) {
+			limits->timed_out = true;
+			break;
+		}
+		if(limits && limits->cancel && *limits->cancel) {
+			limits->cancelled = true;
+			break;
+		}
+		if(limits && limits->progress && iteration % SEARCH_PROGRESS_EVERY == 0
+		   && !limits->progress(limits->progress_data, iteration,
+		           std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count())) {
+			limits->cancelled = true;
+			break;
+		}
+		search_stats.open_peak = std::max(search_stats.open_peak, (unsigned long)todo.size());
 		PrioritizedState prio_current = todo.top();
 		todo.pop();
-		State *current = prio_current.state;
-		if(current->is_goal()) {
+		StateT *current = static_cast<StateT *>(prio_current.state);
+		if(current->StateT::is_goal()) {
 			goal = current;
 			break;
 		}
-		std::vector<State *> neighbors = current->get_neighbors();
+		search_stats.expanded++;
+		neighbors.clear();
+		current->StateT::expand(neighbors);
+		search_stats.generated += neighbors.size();
+		Cost next_f = COST_INFINITY; // Lowest f of the successors left out (partial expansion)
 		for(std::vector<State *>::iterator it = neighbors.begin(); it != neighbors.end(); ++it) {
-			visited.insert(static_cast<Game *>(*it));
-			State *neighbor = visited.find(*static_cast<Game *>(*it));
-			double old_g = (g.count(neighbor) ? g[neighbor] : INFINITY);
-			double tentative_g = g[current] + 1;
-			if(tentative_g < old_g) {
-				double h = heuristic(*neighbor);
-				if(h <= best) {
-					best = h;
-					if(verbose) {
-						char *viz = board_to_string(*static_cast<Game *>(neighbor));
-						fprintf(stderr, "Iteration #%lu\nBest found state: %f\n%s\n", iteration, best, viz);
-					}
+			StateT *successor = static_cast<StateT *>(*it);
+			// With partial expansion, a new state is only stored once it is
+			// known to go onto the open list.
+			StateT *neighbor = static_cast<StateT *>(partial ? visited.find(*successor)
+			                                                 : visited.intern(successor));
+			Cost old_g = (neighbor && g.count(neighbor) ? g[neighbor] : COST_INFINITY);
+			// The transition cost is taken from the freshly generated
+			// successor; the stored copy may have been reached differently.
+			Cost tentative_g = g[current] + cost->step(*current, *successor);
+			if(neighbor && neighbor != successor) {
+				delete_state(successor);
+				search_stats.duplicates++;
+				if(tentative_g < old_g) {
+					search_stats.reopened++;
 				}
-				predecessor[neighbor] = current;
-				g[neighbor] = tentative_g;
-				double f = tentative_g + h;
-				todo.push(PrioritizedState(f, neighbor));
+			} else if(neighbor) {
+				memory += neighbor->StateT::footprint() + A_STAR_STATE_OVERHEAD;
+				search_stats.bytes_stored = memory;
+			}
+			if(tentative_g >= old_g) {
+				continue;
+			}
+			double h = evaluate(heuristic, (neighbor ? *neighbor : *successor));
+			if(h == INFINITY) {
+				search_stats.pruned_heuristic++;
+			}
+			Cost f = tentative_g + cost->estimate(h);
+			if(partial && f > prio_current.priority) {
+				next_f = std::min(next_f, f);
+				if(!neighbor) {
+					delete_state(successor);
+				}
+				continue;
+			}
+			if(!neighbor) {
+				neighbor = static_cast<StateT *>(visited.intern(successor));
+				memory += neighbor->StateT::footprint() + A_STAR_STATE_OVERHEAD;
+				search_stats.bytes_stored = memory;
 			}
+			if(h <= best) {
+				best = h;
+				best_state = neighbor;
+			}
+			predecessor[neighbor] = current;
+			g[neighbor] = tentative_g;
+			if(checkpoint) {
+				checkpoint->generated(neighbor, current, tentative_g);
+			}
+			todo.push(PrioritizedState(f, neighbor));
+		}
+		if(next_f < COST_INFINITY) {
+			// Partial expansion: current comes back for the successors left
+			// out once the search has reached their f.
+			todo.push(PrioritizedState(next_f, current));
+		} else if(checkpoint) {
+			checkpoint->expanded(current);
 		}
 	}
 
+	if(checkpoint) {
+		checkpoint->commit(iteration);
+	}
+	if(reporter) {
+		reporter->report(*static_cast<Game *>(goal ? goal : best_state), best, iteration,
+		                 todo.size(), g.size());
+		delete reporter;
+	}
+
 	std::vector<State *> out;
 	if(goal) {
+		TRACE_SPAN("reconstruct path");
 		do {
 			out.push_back(goal);
 			goal = predecessor[goal];
@@ -150,6 +394,16 @@ std::vector<State *> A_star(State &start, Heuristic &heuristic, bool verbose = t
 		out.push_back(&start);
 		std::reverse(out.begin(), out.end());
 	}
+	if(limits) {
+		limits->n_expanded = iteration;
+	}
+
+	std::unordered_set<State *> keep(out.begin(), out.end());
+	visited.for_each([&keep](Game *state) {
+		if(!keep.count(state)) {
+			delete_state(state);
+		}
+	});
 	return out;
 
 }
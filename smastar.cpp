@@ -0,0 +1,401 @@
+#include <cstdio>
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include "game.cpp"
+#include "search.cpp"
+#include "cost.cpp"
+#include "trace.cpp"
+
+#ifndef SMASTAR_H
+#define SMASTAR_H
+
+/** *************************************************************************
+ * Memory-Bounded A* Search
+ * ************************************************************************** */
+
+/**
+ * A node of the search tree kept in memory.
+ *
+ * f is the node's own (pathmax) estimate. Once a node has been expanded, its
+ * children carry the estimates for everything below it, except for children
+ * that were forgotten to free memory: forgotten holds the lowest f-value of
+ * those, backed up from the forgotten subtrees. key is the value the node is
+ * ordered by in the open list: f while it has not been expanded, forgotten
+ * afterwards (it is then only open to regenerate forgotten children).
+ *
+ * An expanded node without children or forgotten children is closed: all of
+ * its successors are reached more cheaply elsewhere. It is only kept for
+ * duplicate detection, as long as memory allows.
+ */
+struct SMANode {
+	State *state;
+	SMANode *parent;
+	std::vector<SMANode *> children;
+	Cost g;
+	Cost f;
+	Cost forgotten;
+	Cost key;
+	int depth;
+	bool expanded;
+	bool open;
+	bool closed;
+	std::list<SMANode *>::iterator closed_it;
+	unsigned long id;
+};
+
+/**
+ * Open list order: lowest key first, deeper nodes first among equal keys.
+ * The end of the order therefore holds the least promising (and, among those,
+ * shallowest) nodes.
+ */
+struct SMAOrder {
+	bool operator()(const SMANode *a, const SMANode *b) const {
+		if(a->key != b->key) {
+			return a->key < b->key;
+		}
+		if(a->depth != b->depth) {
+			return a->depth > b->depth;
+		}
+		return a->id < b->id;
+	}
+};
+
+/**
+ * Bytes per node on top of the node itself and its state: the entries in
+ * the state table, the open (or closed) list, and the parent's list of
+ * children.
+ */
+#define SMA_NODE_OVERHEAD (4 * sizeof(void *) + 6 * sizeof(void *) + sizeof(void *))
+
+/**
+ * Bytes per entry of the table of dropped closed states (hash, g, and the
+ * hash table's own entry and bucket).
+ */
+#define SMA_DROPPED_OVERHEAD (2 * sizeof(size_t) + sizeof(Cost) + 2 * sizeof(void *))
+
+/**
+ * Simplified memory-bounded A* (SMA*). Behaves like A* as long as the search
+ * tree fits into max_memory bytes. When it does not, closed nodes are
+ * dropped first (oldest first), then the least promising leaf (highest f,
+ * shallowest) is forgotten, and its f-value is backed up into its parent,
+ * which goes back into the open list so that the leaf can be regenerated
+ * should everything else turn out to be more expensive.
+ *
+ * Levels have many transpositions, and most nodes of a search are closed.
+ * A dropped closed node therefore keeps its hash and g-value in a compact
+ * table (about 40 instead of several hundred bytes), and a state reached
+ * again no more cheaply is not generated a second time: its successors are
+ * covered by the nodes that made it closed. Without this, a budget somewhat
+ * below what A* needs would re-search the expanded part of the state space
+ * over and over. The table may use up to half of the budget and is cleared
+ * when it grows beyond that. As in the compact search, two states with the
+ * same hash are mistaken for one, which may cost optimality.
+ *
+ * With an admissible heuristic, the solution is optimal provided the
+ * optimal solution path fits into memory; otherwise, the search keeps
+ * working within the budget and returns the best solution it can hold. The
+ * budget covers the nodes, their states and the search's tables, not the
+ * heuristic's own data.
+ */
+struct SMAStar {
+	Heuristic &heuristic;
+	CostModel *cost;
+	size_t max_memory;
+	bool verbose;
+
+	std::unordered_map<State *, SMANode *, StatePointerHash, StatePointerEqual> table;
+	std::set<SMANode *, SMAOrder> open;
+	std::list<SMANode *> closed;
+	std::unordered_map<size_t, Cost> dropped; // Hash and g of dropped closed nodes
+	SMANode *root;
+	std::vector<State *> solution;
+	size_t used;
+	unsigned long n_nodes;
+	unsigned long n_expanded;
+	unsigned long n_forgotten;
+	bool over_budget;
+
+	SMAStar(Heuristic &heuristic, CostModel *cost, size_t max_memory, bool verbose) :
+		heuristic(heuristic), cost(cost), max_memory(max_memory), verbose(verbose),
+		root(NULL), used(0), n_nodes(0), n_expanded(0), n_forgotten(0),
+		over_budget(false) {}
+
+	/**
+	 * Free all nodes, and all states except the start state and those on
+	 * the solution path.
+	 */
+	~SMAStar() {
+		std::unordered_set<State *> keep(this->solution.begin(), this->solution.end());
+		if(this->root) {
+			keep.insert(this->root->state);
+		}
+		for(std::unordered_map<State *, SMANode *, StatePointerHash, StatePointerEqual>::iterator
+		    it = this->table.begin(); it != this->table.end(); ++it) {
+			if(!keep.count(it->first)) {
+				delete_state(it->first);
+			}
+			delete it->second;
+		}
+	}
+
+	size_t node_size(SMANode *node) {
+		return sizeof(SMANode) + static_cast<Game *>(node->state)->footprint()
+		       + SMA_NODE_OVERHEAD;
+	}
+
+	size_t memory() {
+		return this->used + this->table.bucket_count() * sizeof(void *)
+		       + this->dropped.size() * SMA_DROPPED_OVERHEAD;
+	}
+
+	SMANode *create(State *state, SMANode *parent, Cost g) {
+		SMANode *node = new SMANode();
+		node->state = state;
+		node->parent = parent;
+		node->g = g;
+		node->f = 0;
+		node->forgotten = COST_INFINITY;
+		node->key = 0;
+		node->depth = (parent ? parent->depth + 1 : 0);
+		node->expanded = false;
+		node->open = false;
+		node->closed = false;
+		node->id = this->n_nodes++;
+		this->table[state] = node;
+		this->used += this->node_size(node);
+		return node;
+	}
+
+	void destroy(SMANode *node) {
+		assert(node->children.empty() && node != this->root);
+		this->close(node);
+		if(node->closed) {
+			this->closed.erase(node->closed_it);
+		}
+		this->table.erase(node->state);
+		this->used -= this->node_size(node);
+		delete_state(node->state);
+		delete node;
+	}
+
+	/**
+	 * (Re-)insert node into the open list with its current key.
+	 */
+	void reopen(SMANode *node) {
+		this->close(node);
+		node->key = (node->expanded ? node->forgotten : node->f);
+		this->open.insert(node);
+		node->open = true;
+		if(node->closed) {
+			this->closed.erase(node->closed_it);
+			node->closed = false;
+		}
+	}
+
+	void close(SMANode *node) {
+		if(node->open) {
+			this->open.erase(node);
+			node->open = false;
+		}
+	}
+
+	/**
+	 * Put node on the closed list if it has become closed.
+	 */
+	void check_closed(SMANode *node) {
+		if(node->expanded && node->children.empty() && node->forgotten >= COST_INFINITY
+		   && !node->closed) {
+			this->close(node);
+			node->closed_it = this->closed.insert(this->closed.end(), node);
+			node->closed = true;
+		}
+	}
+
+	void detach(SMANode *node) {
+		std::vector<SMANode *> &siblings = node->parent->children;
+		siblings.erase(std::find(siblings.begin(), siblings.end(), node));
+	}
+
+	/**
+	 * A path to node that is cheaper by delta was found: update node and its
+	 * subtree, which move along with it, to depth.
+	 */
+	void relocate(SMANode *node, Cost delta, int depth) {
+		bool was_open = node->open;
+		this->close(node); // Key and depth are part of the open list order
+		node->g -= delta;
+		node->f -= delta;
+		if(node->forgotten < COST_INFINITY) {
+			node->forgotten -= delta;
+		}
+		node->depth = depth;
+		for(size_t i = 0; i < node->children.size(); i++) {
+			this->relocate(node->children[i], delta, depth + 1);
+		}
+		if(was_open) {
+			this->reopen(node);
+		}
+	}
+
+	/**
+	 * Free memory for count more nodes, never forgetting keep.
+	 */
+	void make_room(size_t count, SMANode *keep) {
+		size_t needed = count * this->node_size(keep);
+		while(this->memory() + needed > this->max_memory) {
+			if(!this->closed.empty()) {
+				SMANode *node = this->closed.front();
+				SMANode *parent = node->parent;
+				if(this->dropped.size() * SMA_DROPPED_OVERHEAD > this->max_memory / 2) {
+					this->dropped.clear();
+				}
+				size_t hash = node->state->hash();
+				if(!this->dropped.count(hash) || this->dropped[hash] > node->g) {
+					this->dropped[hash] = node->g;
+				}
+				this->detach(node);
+				this->destroy(node);
+				this->check_closed(parent);
+				continue;
+			}
+			if(!this->forget_worst(keep)) {
+				if(!this->over_budget && this->verbose) {
+					fprintf(stderr, "Memory budget too small for the current path.\n");
+				}
+				this->over_budget = true;
+				break;
+			}
+		}
+	}
+
+	/**
+	 * Forget the least promising leaf other than keep. Returns false if
+	 * there is none.
+	 */
+	bool forget_worst(SMANode *keep) {
+		std::set<SMANode *, SMAOrder>::reverse_iterator it;
+		for(it = this->open.rbegin(); it != this->open.rend(); ++it) {
+			if(*it != keep && *it != this->root && (*it)->children.empty()) {
+				break;
+			}
+		}
+		if(it == this->open.rend()) {
+			return false;
+		}
+		SMANode *leaf = *it;
+		SMANode *parent = leaf->parent;
+		parent->forgotten = std::min(parent->forgotten, leaf->key);
+		this->detach(leaf);
+		this->destroy(leaf);
+		this->n_forgotten++;
+		this->reopen(parent);
+		return true;
+	}
+
+	/**
+	 * Generate the successors of node that are not in memory yet (all of
+	 * them on the first expansion, the forgotten ones afterwards).
+	 */
+	void expand(SMANode *node) {
+		std::vector<State *> neighbors = node->state->get_neighbors();
+		this->make_room(neighbors.size(), node);
+		Cost bound = (node->expanded ? node->forgotten : node->f);
+		node->expanded = true;
+		node->forgotten = COST_INFINITY;
+		this->close(node);
+		this->n_expanded++;
+		for(size_t i = 0; i < neighbors.size(); i++) {
+			Cost g = node->g + this->cost->step(*node->state, *neighbors[i]);
+			std::unordered_map<State *, SMANode *, StatePointerHash,
+			                   StatePointerEqual>::iterator it = this->table.find(neighbors[i]);
+			if(it != this->table.end()) {
+				SMANode *child = it->second;
+				delete_state(neighbors[i]);
+				if(child->g <= g || child == this->root) {
+					continue;
+				}
+				// Cheaper path to a node in memory: move it, with its
+				// subtree, below node. If it was expanded, it is expanded
+				// again, since successors that were reached more cheaply
+				// elsewhere before may now be improved on.
+				SMANode *old_parent = child->parent;
+				this->detach(child);
+				this->relocate(child, child->g - g, node->depth + 1);
+				child->parent = node;
+				node->children.push_back(child);
+				if(child->expanded) {
+					child->forgotten = std::min(child->forgotten, child->f);
+					this->reopen(child);
+				}
+				this->check_closed(old_parent);
+				continue;
+			}
+			if(!this->dropped.empty()) {
+				std::unordered_map<size_t, Cost>::iterator closed =
+					this->dropped.find(neighbors[i]->hash());
+				if(closed != this->dropped.end() && closed->second <= g) {
+					delete_state(neighbors[i]);
+					continue;
+				}
+			}
+			double h = evaluate(this->heuristic, *neighbors[i]);
+			if(h == INFINITY) {
+				delete_state(neighbors[i]);
+				continue;
+			}
+			SMANode *child = this->create(neighbors[i], node, g);
+			child->f = std::max(g + this->cost->estimate(h), std::max(node->f, bound));
+			node->children.push_back(child);
+			this->reopen(child);
+		}
+		this->check_closed(node);
+	}
+
+	std::vector<State *> run(State &start) {
+		this->root = this->create(&start, NULL, 0);
+		this->root->f = this->cost->estimate(evaluate(this->heuristic, start));
+		this->reopen(this->root);
+		SMANode *goal = NULL;
+		while(!this->open.empty()) {
+			SMANode *best = *this->open.begin();
+			if(best->key >= COST_INFINITY) {
+				break;
+			}
+			if(best->state->is_goal()) {
+				goal = best;
+				break;
+			}
+			this->expand(best);
+		}
+		if(this->verbose) {
+			fprintf(stderr, "SMA*: %lu expanded, %lu forgotten, %lu nodes in memory (%lu bytes).\n",
+			        this->n_expanded, this->n_forgotten, (unsigned long)this->table.size(),
+			        (unsigned long)this->memory());
+		}
+		for(SMANode *node = goal; node; node = node->parent) {
+			this->solution.push_back(node->state);
+		}
+		std::reverse(this->solution.begin(), this->solution.end());
+		return this->solution;
+	}
+};
+
+/**
+ * Memory-bounded A* search, see SMAStar. The interface is the same as for
+ * A_star, with the budget given in bytes.
+ */
+std::vector<State *> SMA_star(State &start, Heuristic &heuristic, size_t max_memory,
+                              bool verbose = true, CostModel *cost = NULL) {
+	TRACE_SPAN("SMA* search");
+	MoveCost move_cost;
+	SMAStar search(heuristic, (cost ? cost : &move_cost), max_memory, verbose);
+	return search.run(start);
+}
+
+#endif
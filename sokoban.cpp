@@ -1,16 +1,37 @@
 #include <cstdio>
 #include <cstdlib>
 #include <unistd.h>
+#include <getopt.h>
 #include <cstdbool>
 #include <cstring>
 #include <cassert>
 #include <vector>
 #include <functional>
+#include <chrono>
 #include "game.cpp"
 #include "search.cpp"
 #include "heuristic.cpp"
 #include "mincostheuristic.cpp"
 #include "io.cpp"
+#include "externalsearch.cpp"
+#include "compactsearch.cpp"
+#include "decompose.cpp"
+#include "level.cpp"
+#include "deadlock.cpp"
+#include "pushgame.cpp"
+#include "dispatch.cpp"
+#include "cost.cpp"
+#include "beamsearch.cpp"
+#include "checkpoint.cpp"
+#include "smastar.cpp"
+#include "batch.cpp"
+#include "collection.cpp"
+#include "cache.cpp"
+#include "daemon.cpp"
+#include "hint.cpp"
+#include "generator.cpp"
+#include "stats.cpp"
+#include "trace.cpp"
 
 
 /** 
@@ -54,35 +75,77 @@ int action_input(Coord *action) {
 	return input;
 }
 
+/**
+ * The key action_input takes for a move (L, R, U, D).
+ */
+char action_key(char move) {
+	switch(move) {
+		case 'L': return 'a';
+		case 'R': return 'd';
+		case 'U': return 'w';
+		default: return 's';
+	}
+}
+
 /**
  * Translate "difference" between two states into action taken: up, down, left
  * or right.
  */
 char action_to_char(Game *from, Game *to) {
-	Coord offs = to->player - from->player;
-	if(offs.x == -1) {
-		return 'L';
-	} else if(offs.x == +1) {
-		return 'R';
-	} else if(offs.y == -1) {
-		return 'U';
-	} else if(offs.y == +1) {
-		return 'D';
-	}
-	return '?';
+	return action_char(to->player - from->player);
 }
 
 /**
  * Usage information / help
  */
 int print_usage(char *name) {
-	fprintf(stderr, "Usage: %s LEVEL [-p] [-s] [-v] [-r] [-l]\n", name);
-	fprintf(stderr, "    LEVEL: Path to Sokoban level text file.\n");
-	fprintf(stderr, "    -p: Play in interactive mode.\n");
+	fprintf(stderr, "Usage: %s LEVEL [-p] [-s] [-v] [-r] [-l] [-e DIR] [-c COST] [-m] [-i] [-k] [-d FILE] [-b WIDTH]\n"
+	                "       [--checkpoint FILE [--resume]] [--max-mem SIZE] [--level N] [--cache FILE]\n"
+	                "       [--stats=json [--stats-every SEC]] [--trace FILE] [--partial-expansion] [--compact]\n"
+	                "       [--decompose [-j N]]\n"
+	                "       %s --batch LEVEL|DIR... [-j N] [--time-limit SEC] [--mem-limit SIZE]\n"
+	                "       [-s] [-l] [-c COST] [-m] [-i] [--cache FILE] [--stats=json] [--trace FILE]\n"
+	                "       [--partial-expansion]\n"
+	                "       %s --daemon SOCKET [-j N] [--time-limit SEC] [--mem-limit SIZE]\n"
+	                "       [-s] [-c COST] [-m] [-i] [--cache FILE] [--trace FILE] [--partial-expansion]\n"
+	                "       %s --generate WxH [--boxes N] [--difficulty N] [--seed N] [--count N]\n",
+	                name, name, name, name);
+	fprintf(stderr, "    LEVEL: Path to Sokoban level text file, or XSB/SOK collection (.xsb, .sok).\n");
+	fprintf(stderr, "    -p: Play in interactive mode (x for a hint).\n");
 	fprintf(stderr, "    -s: Use simple heuristic (for performance comparison).\n");
 	fprintf(stderr, "    -v, -vv: Print (very) verbose output to stderr.\n");
 	fprintf(stderr, "    -r: Replay solution after it has been found\n");
 	fprintf(stderr, "    -l: Use alternative visual input format.\n");
+	fprintf(stderr, "    -e DIR: External-memory search, spilling states to files in DIR.\n");
+	fprintf(stderr, "    -c COST: Optimize moves (default), pushes, pushes-moves or moves-pushes.\n");
+	fprintf(stderr, "    -m: Use tunnel and goal room macro moves (with -c pushes).\n");
+	fprintf(stderr, "    -i: Prune pushes outside of PI-corrals (with -c pushes).\n");
+	fprintf(stderr, "    -k: Learn deadlock patterns during search.\n");
+	fprintf(stderr, "    -d FILE: Like -k, loading and saving the patterns in FILE.\n");
+	fprintf(stderr, "    -b WIDTH: Beam search of given width (fast, not optimal).\n");
+	fprintf(stderr, "    -C, --checkpoint FILE: Periodically checkpoint the search to FILE.\n");
+	fprintf(stderr, "    -R, --resume: Resume the search from the checkpoint in FILE.\n");
+	fprintf(stderr, "    -M, --max-mem SIZE: Memory-bounded search using at most SIZE bytes (K, M, G suffixes);\n"
+	                "      slows down sharply once SIZE is well below what A* would use.\n");
+	fprintf(stderr, "    --level N: Take the Nth level (from 1) of a collection.\n");
+	fprintf(stderr, "    --cache FILE: Look up and store solutions in the cache FILE.\n");
+	fprintf(stderr, "    --batch: Solve all given levels (files or directories), printing one JSON line per level.\n");
+	fprintf(stderr, "    --daemon SOCKET: Serve solve requests on the Unix domain socket SOCKET.\n");
+	fprintf(stderr, "    -j, --jobs N: Solve N levels at a time in batch or daemon mode, or N subproblems with --decompose.\n");
+	fprintf(stderr, "    --time-limit SEC: Give up on a level after SEC seconds in batch or daemon mode (setup\n"
+	                "      included; freeing the search's states afterwards can add a fraction of a second).\n");
+	fprintf(stderr, "    --mem-limit SIZE: Give up on a level once its states use SIZE bytes in batch or daemon mode.\n");
+	fprintf(stderr, "    --stats=json: Print search statistics as JSON (to stderr, or per level in batch mode).\n");
+	fprintf(stderr, "    --stats-every SEC: With --stats, also print them every SEC seconds during A* search.\n");
+	fprintf(stderr, "    --trace FILE: Write a trace of the solve's phases to FILE (Chrome trace event format).\n");
+	fprintf(stderr, "    --partial-expansion: Queue only the successors an A* expansion needs now (saves memory).\n");
+	fprintf(stderr, "    --compact: A* storing states as moves from periodic anchor states (about 25 bytes each).\n");
+	fprintf(stderr, "    --decompose: Solve independent groups of boxes separately, in parallel (not optimal in moves).\n");
+	fprintf(stderr, "    --generate WxH: Print solvable levels of W by H fields as an XSB collection.\n");
+	fprintf(stderr, "    --boxes N: Boxes per generated level (default 3).\n");
+	fprintf(stderr, "    --difficulty N: Box pulls away from the goals per generated level (default 20).\n");
+	fprintf(stderr, "    --seed N: Seed of the first generated level (default 1).\n");
+	fprintf(stderr, "    --count N: Number of levels to generate (default 1).\n");
 	return 1;
 }
 
@@ -90,13 +153,84 @@ int print_usage(char *name) {
  * Replay solution
  */
 void replay_solution(std::vector<State *> solution) {
-	for(std::vector<State *>::iterator it = solution.begin(); it != solution.end(); ++it) {
-		fprintf(stderr, "%s\n\n", board_to_string(*static_cast<Game *>(*it)));
-		fflush(stderr);
+	BoardRenderer renderer(stderr);
+	char status[64];
+	for(size_t i = 0; i < solution.size(); i++) {
+		snprintf(status, sizeof(status), "Step %lu/%lu", (unsigned long)i,
+		         (unsigned long)solution.size() - 1);
+		renderer.draw(*static_cast<Game *>(solution[i]), status);
 		usleep(150000);
 	}
 }
 
+/**
+ * Write the trace at exit (see trace.cpp).
+ */
+void write_trace() {
+	if(!tracer.write()) {
+		fprintf(stderr, "Cannot write trace %s.\n", tracer.path);
+	}
+}
+
+/**
+ * Print the search statistics of this thread (see stats.cpp) as a line of
+ * JSON to stderr, along with the cache counters if a cache is used.
+ */
+void print_stats(double seconds, bool final, SolutionCache *cache) {
+	fprintf(stderr, "{\"final\": %s, \"time\": %.3f, \"stats\": %s",
+	        (final ? "true" : "false"), seconds, search_stats.json().c_str());
+	if(cache) {
+		fprintf(stderr, ", \"cache_hits\": %lu, \"cache_misses\": %lu", cache->n_hits, cache->n_misses);
+	}
+	fprintf(stderr, "}\n");
+}
+
+/**
+ * Search progress callback printing the statistics every interval seconds.
+ */
+struct StatsTicker {
+	double interval;
+	double next;
+	SolutionCache *cache;
+
+	static bool tick(void *data, unsigned long n_expanded, double seconds) {
+		StatsTicker *ticker = static_cast<StatsTicker *>(data);
+		if(seconds >= ticker->next) {
+			print_stats(seconds, false, ticker->cache);
+			ticker->next = seconds + ticker->interval;
+		}
+		return true;
+	}
+};
+
+/**
+ * Print the solution as the number of states followed by the moves, and
+ * replay it if asked to.
+ */
+int print_solution(std::vector<State *> &solution, bool replay) {
+	TRACE_SPAN("output");
+	printf("%lu ", solution.size());
+	Game *prev = NULL;
+	for(std::vector<State *>::iterator it = solution.begin(); it != solution.end(); ++it) {
+		Game *current = static_cast<Game *>(*it);
+		if(!prev) {
+			prev = current;
+			continue;
+		}
+		char action = action_to_char(prev, current);
+		putchar(action);
+		putchar(' ');
+		prev = current;
+	}
+	putchar('\n');
+	if(replay) {
+		fprintf(stderr, "\nSolution replay:\n");
+		usleep(2000000);
+		replay_solution(solution);
+	}
+	return 0;
+}
+
 /**
  * Main
  */
@@ -112,10 +246,60 @@ int main(int argc, char **argv) {
 	bool replay = false;
 	bool old_fmt = false;
 	int verbosity = 0;
+	char *external_dir = NULL;
+	CostModel *cost = NULL;
+	bool macros = false;
+	bool corrals = false;
+	bool learn_deadlocks = false;
+	char *deadlock_file = NULL;
+	size_t beam_width = 0;
+	char *checkpoint_file = NULL;
+	bool resume = false;
+	size_t max_memory = 0;
+	bool batch = false;
+	unsigned long level_number = 1;
+	const char *cost_name = "moves";
+	char *cache_file = NULL;
+	char *daemon_socket = NULL;
+	bool stats = false;
+	double stats_every = 0;
+	char *trace_file = NULL;
+	bool partial = false;
+	bool compact = false;
+	bool decompose = false;
+	DecomposeOptions decompose_options;
+	bool generate = false;
+	GeneratorOptions generator_options;
+	unsigned long generate_count = 1;
+	BatchOptions batch_options;
 
 	// all args except for file are optional
+	static struct option long_options[] = {
+		{"checkpoint", required_argument, NULL, 'C'},
+		{"resume", no_argument, NULL, 'R'},
+		{"max-mem", required_argument, NULL, 'M'},
+		{"batch", no_argument, NULL, 'B'},
+		{"jobs", required_argument, NULL, 'j'},
+		{"time-limit", required_argument, NULL, 'T'},
+		{"mem-limit", required_argument, NULL, 'L'},
+		{"level", required_argument, NULL, 'N'},
+		{"cache", required_argument, NULL, 'H'},
+		{"daemon", required_argument, NULL, 'D'},
+		{"stats", required_argument, NULL, 'S'},
+		{"stats-every", required_argument, NULL, 'I'},
+		{"trace", required_argument, NULL, 'W'},
+		{"partial-expansion", no_argument, NULL, 'P'},
+		{"compact", no_argument, NULL, 'Q'},
+		{"decompose", no_argument, NULL, 'O'},
+		{"generate", required_argument, NULL, 'G'},
+		{"boxes", required_argument, NULL, 'X'},
+		{"difficulty", required_argument, NULL, 'Y'},
+		{"seed", required_argument, NULL, 'Z'},
+		{"count", required_argument, NULL, 'K'},
+		{NULL, 0, NULL, 0}
+	};
 	int opt;
-	while((opt = getopt(argc, argv, "lpsvr")) != -1) {
+	while((opt = getopt_long(argc, argv, "lpsvre:c:mikd:b:C:RM:j:", long_options, NULL)) != -1) {
 		switch(opt) {
 			case 'p':
 				interactive = true;
@@ -132,16 +316,288 @@ int main(int argc, char **argv) {
 			case 'l':
 				old_fmt = true;
 				break;
+			case 'e':
+				external_dir = optarg;
+				break;
+			case 'm':
+				macros = true;
+				break;
+			case 'i':
+				corrals = true;
+				break;
+			case 'k':
+				learn_deadlocks = true;
+				break;
+			case 'd':
+				learn_deadlocks = true;
+				deadlock_file = optarg;
+				break;
+			case 'b':
+				beam_width = strtoul(optarg, NULL, 10);
+				if(!beam_width) {
+					return print_usage(argv[0]);
+				}
+				break;
+			case 'C':
+				checkpoint_file = optarg;
+				break;
+			case 'R':
+				resume = true;
+				break;
+			case 'M':
+				max_memory = parse_size(optarg);
+				if(!max_memory) {
+					return print_usage(argv[0]);
+				}
+				break;
+			case 'B':
+				batch = true;
+				break;
+			case 'j':
+				batch_options.jobs = atoi(optarg);
+				if(batch_options.jobs < 1) {
+					return print_usage(argv[0]);
+				}
+				decompose_options.jobs = batch_options.jobs;
+				break;
+			case 'T':
+				batch_options.max_seconds = atof(optarg);
+				if(batch_options.max_seconds <= 0) {
+					return print_usage(argv[0]);
+				}
+				break;
+			case 'L':
+				batch_options.max_memory = parse_size(optarg);
+				if(!batch_options.max_memory) {
+					return print_usage(argv[0]);
+				}
+				break;
+			case 'N':
+				level_number = strtoul(optarg, NULL, 10);
+				if(!level_number) {
+					return print_usage(argv[0]);
+				}
+				break;
+			case 'H':
+				cache_file = optarg;
+				break;
+			case 'D':
+				daemon_socket = optarg;
+				break;
+			case 'S':
+				if(strcmp(optarg, "json") != 0) {
+					return print_usage(argv[0]);
+				}
+				stats = true;
+				break;
+			case 'W':
+				trace_file = optarg;
+				break;
+			case 'P':
+				partial = true;
+				break;
+			case 'Q':
+				compact = true;
+				break;
+			case 'O':
+				decompose = true;
+				break;
+			case 'G':
+				if(sscanf(optarg, "%dx%d", &generator_options.width,
+				          &generator_options.height) != 2) {
+					return print_usage(argv[0]);
+				}
+				generate = true;
+				break;
+			case 'X':
+				generator_options.boxes = atoi(optarg);
+				break;
+			case 'Y':
+				generator_options.difficulty = atoi(optarg);
+				break;
+			case 'Z':
+				generator_options.seed = strtoul(optarg, NULL, 10);
+				break;
+			case 'K':
+				generate_count = strtoul(optarg, NULL, 10);
+				break;
+			case 'I':
+				stats_every = atof(optarg);
+				if(stats_every <= 0) {
+					return print_usage(argv[0]);
+				}
+				break;
+			case 'c':
+				cost_name = optarg;
+				batch_options.cost = optarg;
+				cost = cost_model_from_name(optarg);
+				if(!cost) {
+					fprintf(stderr, "Unknown cost model: %s\n", optarg);
+					return print_usage(argv[0]);
+				}
+				break;
+		}
+	}
+
+	if(generate) {
+		if(optind < argc || batch || daemon_socket || interactive) {
+			fprintf(stderr, "--generate takes no level and cannot be combined with other modes.\n");
+			return 1;
+		}
+		if(!generate_collection(generator_options, generate_count, stdout)) {
+			fprintf(stderr, "Cannot generate a %dx%d level with %d boxes and difficulty %d.\n",
+			        generator_options.width, generator_options.height, generator_options.boxes,
+			        generator_options.difficulty);
+			return 1;
+		}
+		return 0;
+	}
+
+	if(optind >= argc && !daemon_socket) {
+		return print_usage(argv[0]);
+	}
+
+	if(stats_every && !stats) {
+		fprintf(stderr, "--stats-every requires --stats=json.\n");
+		return 1;
+	}
+	if(stats && interactive) {
+		fprintf(stderr, "Statistics are not collected in interactive mode.\n");
+		return 1;
+	}
+	search_stats.reset(stats);
+	if(trace_file) {
+		tracer.enable(trace_file);
+		atexit(write_trace);
+	}
+
+	SolutionCache *cache = NULL;
+	if(cache_file) {
+		if(interactive || beam_width || decompose || max_memory || compact) {
+			fprintf(stderr, "The cache only holds solutions of complete, optimal searches"
+			                " (not -p, -b, --decompose, --max-mem or --compact).\n");
+			return 1;
+		}
+		cache = new SolutionCache();
+		if(!cache->open(cache_file)) {
+			fprintf(stderr, "Cannot use cache %s.\n", cache_file);
+			return 1;
 		}
 	}
 
-	if(optind >= argc) {
-		print_usage(argv[0]);
+	if(daemon_socket) {
+		if(batch || optind < argc || interactive || replay || old_fmt || external_dir
+		   || learn_deadlocks || beam_width || checkpoint_file || max_memory || stats || compact
+		   || decompose) {
+			fprintf(stderr, "Daemon mode supports only -s, -c, -m, -i and --partial-expansion.\n");
+			return 1;
+		}
+		if((macros || corrals) && !(cost && cost->push_graph())) {
+			fprintf(stderr, "Macro moves and corral pruning require searching the push graph (-c pushes).\n");
+			return 1;
+		}
+		batch_options.simple_heuristic = simple_heuristic;
+		batch_options.macros = macros;
+		batch_options.corrals = corrals;
+		batch_options.cache = cache;
+		batch_options.partial = partial;
+		return daemon_run(daemon_socket, batch_options, verbosity > 0);
+	}
+
+	if(batch) {
+		if(interactive || replay || external_dir || learn_deadlocks || beam_width
+		   || checkpoint_file || max_memory || stats_every || compact || decompose) {
+			fprintf(stderr, "Batch mode supports only -s, -l, -c, -m, -i, --stats and --partial-expansion.\n");
+			return 1;
+		}
+		if((macros || corrals) && !(cost && cost->push_graph())) {
+			fprintf(stderr, "Macro moves and corral pruning require searching the push graph (-c pushes).\n");
+			return 1;
+		}
+		batch_options.old_fmt = old_fmt;
+		batch_options.simple_heuristic = simple_heuristic;
+		batch_options.macros = macros;
+		batch_options.corrals = corrals;
+		batch_options.cache = cache;
+		batch_options.stats = stats;
+		batch_options.partial = partial;
+		std::vector<std::string> paths(argv + optind, argv + argc);
+		std::vector<std::string> levels = batch_collect_levels(paths);
+		unsigned long n_levels;
+		int n_solved = batch_run(levels, batch_options, &n_levels);
+		if(verbosity > 0) {
+			fprintf(stderr, "Solved %d of %lu levels.\n", n_solved, n_levels);
+			if(cache) {
+				fprintf(stderr, "Cache: %lu hits, %lu misses.\n", cache->n_hits, cache->n_misses);
+			}
+		}
+		return 0;
 	}
 
 	// Read in level to a new board.
 	char *path = argv[optind];
-	Game board = board_from_file(path, old_fmt);
+	Game board;
+	if(is_collection_file(path)) {
+		LevelCollection collection;
+		if(!collection.open(path)) {
+			fprintf(stderr, "Cannot read %s.\n", path);
+			return 1;
+		}
+		std::string title;
+		int status;
+		while((status = collection.next(&board, &title)) != COLLECTION_END
+		      && collection.n_levels < level_number) {
+			if(status == COLLECTION_LEVEL) {
+				delete[] board.board.fields;
+			}
+		}
+		collection.close();
+		if(status == COLLECTION_END) {
+			fprintf(stderr, "%s has no level %lu.\n", path, level_number);
+			return 1;
+		} else if(status == COLLECTION_INVALID) {
+			fprintf(stderr, "Level %lu of %s does not have exactly one player.\n", level_number, path);
+			return 1;
+		}
+		if(verbosity > 0 && !title.empty()) {
+			fprintf(stderr, "Level %lu: %s\n", level_number, title.c_str());
+		}
+	} else {
+		board = board_from_file(path, old_fmt);
+	}
+	trim_board(board);
+	std::string key;
+	if(cache && !interactive) {
+		key = cache_key(board, cache_objective(cost_name, simple_heuristic, macros, corrals,
+		                                       learn_deadlocks));
+		CacheEntry entry;
+		if(cache->lookup(key, &entry)) {
+			if(verbosity > 0) {
+				fprintf(stderr, "Cached solution (%lu pushes, %lu expansions, %.3f s when solved).\n",
+				        entry.pushes, entry.expansions, entry.seconds);
+			}
+			std::vector<State *> solution;
+			if(entry.solved) {
+				solution = moves_to_solution(board, entry.moves);
+			}
+			if(stats) {
+				print_stats(0, true, cache);
+			}
+			return print_solution(solution, replay);
+		}
+	}
+	if(macros || corrals || learn_deadlocks) {
+		board.level = analyze_level(board);
+		board.level->macros = macros;
+		board.level->corrals = corrals;
+	}
+	if(learn_deadlocks) {
+		board.level->deadlocks = new DeadlockDB(board);
+		if(deadlock_file && board.level->deadlocks->load(deadlock_file) && verbosity > 0) {
+			fprintf(stderr, "Loaded %lu deadlock patterns.\n",
+			        board.level->deadlocks->patterns.size());
+		}
+	}
 
 	Heuristic *heuristic;
 	if(simple_heuristic) {
@@ -152,33 +608,135 @@ int main(int argc, char **argv) {
 
 	// Non-interactive: Read in file, run algorithm, return
 	if(!interactive) {
-		std::vector<State *> solution = A_star(board, *heuristic, verbosity > 1);
+		std::vector<State *> solution;
+		SearchLimits limits;
+		bool complete = false; // Whether an empty solution means unsolvable
+		std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+		StatsTicker ticker = {stats_every, stats_every, cache};
+		if(stats_every) {
+			limits.progress = &StatsTicker::tick;
+			limits.progress_data = &ticker;
+		}
+		if((macros || corrals) && !(cost && cost->push_graph())) {
+			fprintf(stderr, "Macro moves and corral pruning require searching the push graph (-c pushes).\n");
+			return 1;
+		}
+		Checkpoint *checkpoint = NULL;
+		if(resume && !checkpoint_file) {
+			fprintf(stderr, "--resume requires a checkpoint file (--checkpoint FILE).\n");
+			return 1;
+		}
+		if(max_memory && (external_dir || beam_width || checkpoint_file)) {
+			fprintf(stderr, "--max-mem cannot be combined with -e, -b or --checkpoint.\n");
+			return 1;
+		}
+		if(partial && (external_dir || beam_width || max_memory)) {
+			fprintf(stderr, "Partial expansion is only supported by A* search (not -e, -b or --max-mem).\n");
+			return 1;
+		}
+		if(compact && (external_dir || beam_width || max_memory || checkpoint_file || partial)) {
+			fprintf(stderr, "--compact cannot be combined with -e, -b, --max-mem, --checkpoint or --partial-expansion.\n");
+			return 1;
+		}
+		if(decompose && (external_dir || beam_width || max_memory || checkpoint_file || compact
+		                 || learn_deadlocks)) {
+			fprintf(stderr, "--decompose cannot be combined with -e, -b, --max-mem, --checkpoint, --compact or -k.\n");
+			return 1;
+		}
+		if(checkpoint_file) {
+			if(external_dir || beam_width) {
+				fprintf(stderr, "Checkpoints are only supported by A* search.\n");
+				return 1;
+			}
+			checkpoint = new Checkpoint(checkpoint_file);
+		}
+		decompose_options.simple_heuristic = simple_heuristic;
+		decompose_options.cost = (cost ? cost_name : NULL);
+		decompose_options.macros = macros;
+		decompose_options.corrals = corrals;
+		decompose_options.partial = partial;
+		if(decompose && decomposed_solve(board, decompose_options, &limits, verbosity > 0, &solution)) {
+			complete = true;
+		} else if(external_dir) {
+			if(cost) {
+				fprintf(stderr, "External-memory search only minimizes moves.\n");
+				return 1;
+			}
+			solution = external_A_star(board, *heuristic, external_dir,
+			                           (size_t)256 << 20, verbosity > 1);
+			complete = true;
+		} else if(compact) {
+			if(cost && strcmp(cost_name, "moves") != 0) {
+				fprintf(stderr, "Compact search only minimizes moves.\n");
+				return 1;
+			}
+			solution = compact_A_star(board, *heuristic, verbosity > 1, &limits);
+			complete = true;
+		} else if(cost && cost->push_graph()) {
+			PushGame start(board);
+			if(beam_width) {
+				solution = beam_search(start, *heuristic, beam_width, verbosity > 1);
+			} else if(max_memory) {
+				solution = SMA_star(start, *heuristic, max_memory, verbosity > 0, cost);
+			} else {
+				if(checkpoint && !checkpoint->open(start, resume)) {
+					fprintf(stderr, "Cannot use checkpoint %s.\n", checkpoint_file);
+					return 1;
+				}
+				solution = A_star(start, *heuristic, verbosity > 1, cost, checkpoint, &limits, partial);
+				complete = true;
+			}
+			solution = expand_push_solution(board, solution);
+		} else if(beam_width) {
+			solution = beam_search(board, *heuristic, beam_width, verbosity > 1);
+		} else if(max_memory) {
+			solution = SMA_star(board, *heuristic, max_memory, verbosity > 0, cost);
+		} else {
+			if(checkpoint && !checkpoint->open(board, resume)) {
+				fprintf(stderr, "Cannot use checkpoint %s.\n", checkpoint_file);
+				return 1;
+			}
+			solution = A_star(board, *heuristic, verbosity > 1, cost, checkpoint, &limits, partial);
+			complete = true;
+		}
+		if(checkpoint) {
+			checkpoint->close();
+		}
+		if(learn_deadlocks) {
+			DeadlockDB *deadlocks = board.level->deadlocks;
+			if(verbosity > 0) {
+				fprintf(stderr, "Deadlock patterns: %lu learned, %lu hits, %lu sub-searches.\n",
+				        deadlocks->patterns.size(), deadlocks->n_hits, deadlocks->n_searches);
+			}
+			if(deadlock_file) {
+				deadlocks->save(deadlock_file);
+			}
+		}
 		if(verbosity > 0) {
 			fprintf(stderr, "Solution found:\n");
 		}
-		printf("%lu ", solution.size());
-		Game *prev = NULL;
-		for(std::vector<State *>::iterator it = solution.begin(); it != solution.end(); ++it) {
-			Game *current = static_cast<Game *>(*it);
-			if(!prev) {
-				prev = current;
-				continue;
+		if(cache && (!solution.empty() || complete)) {
+			CacheEntry entry;
+			entry.solved = !solution.empty();
+			entry.moves = solution_to_moves(solution);
+			entry.pushes = 0;
+			for(size_t i = 1; i < solution.size(); i++) {
+				Game *current = static_cast<Game *>(solution[i]);
+				entry.pushes += current->edge_pushes(*static_cast<Game *>(solution[i-1]));
 			}
-			char action = action_to_char(prev, current);
-			putchar(action);
-			putchar(' ');
-			prev = current;
+			entry.expansions = limits.n_expanded;
+			entry.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+			cache->store(key, entry);
 		}
-		putchar('\n');
-		if(replay) {
-			fprintf(stderr, "\nSolution replay:\n");
-			usleep(2000000);
-			replay_solution(solution);
+		if(stats) {
+			print_stats(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count(),
+			            true, cache);
 		}
-		return 0;
+		return print_solution(solution, replay);
 	}
 
 	unsigned int n_moves = 0;
+	HintEngine hints(*heuristic);
 
 	// Interactive
 	// Main loop: repeatedly show game board, ask user for a move, apply
@@ -196,25 +754,29 @@ int main(int argc, char **argv) {
 		Coord action;
 		do {
 			// Repeatedly ask user for a move until they make a legal one or quit the game.
-			fprintf(stderr, "[%d] Make a move (x=run solver, w=up, a=left, s=down, d=right, q=quit): ", n_moves);
+			fprintf(stderr, "[%d] Make a move (x=hint, w=up, a=left, s=down, d=right, q=quit): ", n_moves);
 			input = action_input(&action);
 			fprintf(stderr, "\n");
-			if(input == 'q') {
+			if(input == 'q' || input == EOF) {
 				fprintf(stderr, "You gave up after %d moves. Goodbye.\n", n_moves);
 				return 1;
 			}
 			if(input == 'x') {
-				std::vector<State *> solution = A_star(board, *heuristic);
-				int j = 0;
-				for(std::vector<State *>::iterator it = solution.begin(); it != solution.end(); ++it) {
-					Game *step = static_cast<Game *>(*it);
-					char *viz = board_to_string(*step);
-					fprintf(stderr, "Solution step %d:\n%s\n", j+1, viz);
-					j++;
+				char move;
+				unsigned long n_expanded = hints.n_expanded;
+				Cost left = hints.hint(board, &move);
+				if(left >= COST_INFINITY) {
+					fprintf(stderr, "The level cannot be solved from here.\n");
+				} else {
+					fprintf(stderr, "Hint: press %c (%llu moves left).\n",
+					        action_key(move), left);
+				}
+				if(verbosity > 0) {
+					fprintf(stderr, "Expanded %lu states for this hint (%lu searches so far).\n",
+					        hints.n_expanded - n_expanded, hints.n_searches);
 				}
-				return 2;
 			}
-		} while(!board.is_action_legal(action));
+		} while(input == 'x' || !board.is_action_legal(action));
 		n_moves += 1;
 		board.take_action(action);
 	}
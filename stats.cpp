@@ -0,0 +1,81 @@
+#include <cstdio>
+#include <string>
+
+#ifndef STATS_H
+#define STATS_H
+
+/** *************************************************************************
+ * Search Statistics
+ * ************************************************************************** */
+
+/**
+ * Counters filled in while searching. Each thread has its own set
+ * (search_stats below), so counting is a plain increment wherever it
+ * happens, including deep inside get_neighbors; whoever runs a search resets
+ * the counters of its thread before and reads them after.
+ *
+ * Only the time spent in the heuristic needs the clock, so it is measured
+ * only if timing is set. The struct is kept trivial, so that the thread-local
+ * instance needs no initialization guard on access.
+ */
+struct SearchStats {
+	unsigned long expanded;         // States taken off the open list
+	unsigned long generated;        // Successors generated
+	unsigned long duplicates;       // Successors that had been seen before
+	unsigned long reopened;         // Seen states reached again on a cheaper path
+	unsigned long pruned_corner;    // Successors with a box stuck in a corner
+	unsigned long pruned_pattern;   // Successors matching a learned deadlock pattern
+	unsigned long pruned_corral;    // Boxes not pushed because of a PI-corral
+	unsigned long pruned_heuristic; // Successors the heuristic deems unsolvable
+	unsigned long heuristic_calls;
+	double heuristic_seconds;
+	unsigned long open_peak;        // Largest size of the open list
+	unsigned long bytes_stored;     // Estimated bytes of stored states
+	bool timing;
+
+	void reset(bool timing) {
+		*this = SearchStats();
+		this->timing = timing;
+	}
+
+	/**
+	 * Add the counters of another thread's searches. The peaks add up too,
+	 * as those searches may have run at the same time.
+	 */
+	void add(const SearchStats &other) {
+		this->expanded += other.expanded;
+		this->generated += other.generated;
+		this->duplicates += other.duplicates;
+		this->reopened += other.reopened;
+		this->pruned_corner += other.pruned_corner;
+		this->pruned_pattern += other.pruned_pattern;
+		this->pruned_corral += other.pruned_corral;
+		this->pruned_heuristic += other.pruned_heuristic;
+		this->heuristic_calls += other.heuristic_calls;
+		this->heuristic_seconds += other.heuristic_seconds;
+		this->open_peak += other.open_peak;
+		this->bytes_stored += other.bytes_stored;
+	}
+
+	/**
+	 * The counters as a JSON object.
+	 */
+	std::string json() {
+		char out[768];
+		snprintf(out, sizeof(out),
+		         "{\"expanded\": %lu, \"generated\": %lu, \"duplicates\": %lu, "
+		         "\"reopened\": %lu, \"pruned_corner\": %lu, \"pruned_pattern\": %lu, "
+		         "\"pruned_corral\": %lu, \"pruned_heuristic\": %lu, "
+		         "\"heuristic_calls\": %lu, \"heuristic_time\": %.6f, "
+		         "\"open_peak\": %lu, \"bytes_stored\": %lu}",
+		         this->expanded, this->generated, this->duplicates, this->reopened,
+		         this->pruned_corner, this->pruned_pattern, this->pruned_corral,
+		         this->pruned_heuristic, this->heuristic_calls, this->heuristic_seconds,
+		         this->open_peak, this->bytes_stored);
+		return out;
+	}
+};
+
+thread_local SearchStats search_stats;
+
+#endif
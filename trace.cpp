@@ -0,0 +1,172 @@
+#include <cstdio>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/** *************************************************************************
+ * Phase Tracing
+ * ************************************************************************** */
+
+/**
+ * Spans of time spent in the phases of a solve (parsing, heuristic tables,
+ * search, ...) are recorded while tracing is enabled (--trace FILE) and
+ * written out in the Chrome trace event format, which trace viewers such as
+ * chrome://tracing or Perfetto load directly. Every thread gets a track of
+ * its own.
+ *
+ * A span is opened with TRACE_SPAN("name") and closed at the end of the
+ * enclosing scope. Names must be string literals. While tracing is off, a
+ * span costs one load of a flag; building with -DNO_TRACE removes spans
+ * altogether.
+ */
+
+/**
+ * Spans kept per thread at most; later ones are counted but dropped, so that
+ * tracing a long search (which records every assignment solve) cannot run
+ * out of memory.
+ */
+#define TRACE_MAX_EVENTS (1 << 20)
+
+struct TraceEvent {
+	const char *name;
+	double start;    // Microseconds since tracing was enabled
+	double duration; // Microseconds
+};
+
+struct TraceThread {
+	int id;
+	std::vector<TraceEvent> events;
+	unsigned long n_dropped;
+};
+
+struct Tracer {
+	std::atomic<bool> enabled;
+	std::chrono::steady_clock::time_point epoch;
+	std::mutex mutex;
+	std::vector<TraceThread *> threads;
+	const char *path;
+
+	Tracer() : enabled(false), path(NULL) {}
+
+	~Tracer() {
+		for(size_t i = 0; i < this->threads.size(); i++) {
+			delete this->threads[i];
+		}
+	}
+
+	/**
+	 * Start recording; the trace is written to path by write(). To be
+	 * called from the main thread.
+	 */
+	void enable(const char *path) {
+		this->path = path;
+		this->epoch = std::chrono::steady_clock::now();
+		this->thread(); // The calling (main) thread gets the first track
+		this->enabled = true;
+	}
+
+	double now() {
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now()
+		                                                 - this->epoch).count();
+	}
+
+	/**
+	 * The buffer of the calling thread, registered on first use. Buffers
+	 * belong to the tracer, so spans of threads that have ended are kept.
+	 */
+	TraceThread *thread() {
+		static thread_local TraceThread *current = NULL;
+		if(!current) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			current = new TraceThread();
+			current->id = this->threads.size() + 1;
+			current->n_dropped = 0;
+			this->threads.push_back(current);
+		}
+		return current;
+	}
+
+	void record(const char *name, double start, double end) {
+		TraceThread *thread = this->thread();
+		if(thread->events.size() >= TRACE_MAX_EVENTS) {
+			thread->n_dropped++;
+			return;
+		}
+		TraceEvent event = {name, start, end - start};
+		thread->events.push_back(event);
+	}
+
+	/**
+	 * Write all recorded spans. Must not race with threads still recording.
+	 * Returns false if the file cannot be written.
+	 */
+	bool write() {
+		if(!this->enabled) {
+			return true;
+		}
+		this->enabled = false;
+		FILE *fp = fopen(this->path, "w");
+		if(!fp) {
+			return false;
+		}
+		fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		fprintf(fp, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"sokoban\"}}");
+		for(size_t t = 0; t < this->threads.size(); t++) {
+			TraceThread *thread = this->threads[t];
+			char name[32];
+			snprintf(name, sizeof(name), (thread->id == 1 ? "main" : "thread %d"), thread->id);
+			fprintf(fp, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+			        "\"args\": {\"name\": \"%s\"}}", thread->id, name);
+			for(size_t i = 0; i < thread->events.size(); i++) {
+				TraceEvent &event = thread->events[i];
+				fprintf(fp, ",\n{\"name\": \"%s\", \"cat\": \"sokoban\", \"ph\": \"X\", \"pid\": 1, "
+				        "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+				        event.name, thread->id, event.start, event.duration);
+			}
+			if(thread->n_dropped) {
+				fprintf(stderr, "Trace: dropped %lu spans of thread %d.\n", thread->n_dropped, thread->id);
+			}
+		}
+		fprintf(fp, "\n]}\n");
+		return fclose(fp) == 0;
+	}
+};
+
+Tracer tracer;
+
+/**
+ * Records the time from its construction to its destruction as a span, if
+ * tracing was enabled at construction.
+ */
+struct TraceSpan {
+	const char *name;
+	double start;
+
+	TraceSpan(const char *name) : name(NULL) {
+		if(tracer.enabled.load(std::memory_order_relaxed)) {
+			this->name = name;
+			this->start = tracer.now();
+		}
+	}
+
+	~TraceSpan() {
+		if(this->name) {
+			tracer.record(this->name, this->start, tracer.now());
+		}
+	}
+};
+
+#define TRACE_CONCAT_(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef NO_TRACE
+#define TRACE_SPAN(name)
+#else
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+#endif
+
+#endif